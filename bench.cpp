@@ -0,0 +1,420 @@
+#include <iostream>
+#include <tmc>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+// micro benchmarks of the hot paths, each one prints its numbers
+// usage: tmc_bench [name], no name runs them all
+
+using namespace TMC;
+
+typedef std::chrono::steady_clock Clock;
+
+// every operator new of the program is counted
+static std::atomic<size_t> g_allocs{0};
+
+void* operator new(size_t _size){
+    g_allocs.fetch_add(1,std::memory_order_relaxed);
+    if(void* p = std::malloc(_size?_size:1)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* _ptr) noexcept{
+    std::free(_ptr);
+}
+void operator delete(void* _ptr,size_t) noexcept{
+    std::free(_ptr);
+}
+
+static double ns_since(Clock::time_point _start,size_t _count){
+    return std::chrono::duration<double,std::nano>(Clock::now()-_start).count()/(double)_count;
+}
+
+#ifdef __linux__
+
+static const int PING_ROUNDS = 100000;
+static const int PING_SIZE = 64;
+
+// udp socket on 127.0.0.1:_port connected to 127.0.0.1:_peer
+static Socket udp_peer(u_short _port,u_short _peer){
+    Socket sock = Socket::create(Socket::Protocol::UDP).except("create udp");
+    sock.bind(IPAddr::v4("127.0.0.1",_port)).except("bind udp");
+    sock.connect(IPAddr::v4("127.0.0.1",_peer)).except("connect udp");
+    return sock;
+}
+
+// the ping side, sends and waits for the echo PING_ROUNDS times
+// each round trip in ns goes into _lat, false on a read error
+// param _spin poll a non-blocking socket instead of sleeping in recv
+static bool ping(Socket& _sock,bool _spin,std::vector<double>& _lat){
+    ByteBuf msg(std::string(PING_SIZE,'p'));
+    ByteBuf buf;
+    buf.reserve(PING_SIZE);
+    _lat.clear();
+    _lat.reserve(PING_ROUNDS);
+    _sock.set_nonblocking(_spin).no_except("ping nonblocking");
+    for(int i = 0;i<PING_ROUNDS;i++){
+        auto start = Clock::now();
+        _sock.write(msg).no_except("ping write");
+        buf.pop_back(buf.size());
+        while(true){
+            auto ret = _sock.read_into(buf,PING_SIZE);
+            if(ret.check() && ret.ignore()>0) break;
+            if(!ret.check() && !Socket::would_block(ret.error_code())){
+                ret.no_except("ping read");
+                return false;
+            }
+        }
+        _lat.push_back(ns_since(start,1));
+    }
+    return true;
+}
+
+// mean, p50, p99, p99.9 and max of the round trips, sorts _lat
+static void print_latency(const char* _name,std::vector<double>& _lat){
+    std::sort(_lat.begin(),_lat.end());
+    double sum = 0;
+    for(double ns:_lat){
+        sum += ns;
+    }
+    auto at = [&](double _q){
+        return _lat[(size_t)(_q*(double)(_lat.size()-1))];
+    };
+    std::cout << "  " << _name << " mean " << sum/(double)_lat.size()
+        << " p50 " << at(0.5) << " p99 " << at(0.99) << " p99.9 " << at(0.999)
+        << " max " << _lat.back() << " ns per round trip\n";
+}
+
+static const int ALLOC_ROUNDS = 200000;
+
+// the call position as TMC_R_CALL_POS used to take it, on every Result:
+// the local time formatted through a stringstream, function and file copied
+struct EagerCallInfo{
+    std::string time;
+    std::string func;
+    std::string file;
+    int line;
+    int ec;
+};
+
+[[gnu::noinline]] static EagerCallInfo eager_call_pos(int _ec){
+    return EagerCallInfo{_R_datetime(),__FUNCTION__,__FILE__,__LINE__,_ec};
+}
+
+// allocations and time of one write + read_into over a unix socketpair
+// today's lazy call position vs the same calls plus the eager capture for each Result
+static void bench_call_pos(){
+    auto pair_res = Socket::pair();
+    auto& socks = pair_res.except("socketpair");
+    Socket& a = std::get<0>(socks);
+    Socket& b = std::get<1>(socks);
+    ByteBuf msg(std::string(PING_SIZE,'m'));
+    ByteBuf buf;
+    buf.reserve(PING_SIZE);
+    size_t keep = 0;
+    for(int eager = 0;eager<2;eager++){
+        size_t allocs = g_allocs.load();
+        auto start = Clock::now();
+        for(int i = 0;i<ALLOC_ROUNDS;i++){
+            a.write(msg).no_except("call_pos write");
+            buf.pop_back(buf.size());
+            b.read_into(buf,PING_SIZE).no_except("call_pos read");
+            if(eager){
+                keep += eager_call_pos(0).func.size();
+                keep += eager_call_pos(0).file.size();
+            }
+        }
+        double ns = ns_since(start,ALLOC_ROUNDS);
+        double per = (double)(g_allocs.load()-allocs)/ALLOC_ROUNDS;
+        if(!eager){
+            std::cout << "call_pos: " << ALLOC_ROUNDS << " write + read_into over a socketpair\n"
+                << "  lazy call position:  ";
+        }else{
+            std::cout << "  eager call position: ";
+        }
+        std::cout << per << " allocations, " << ns << " ns per round\n";
+    }
+    if(!keep){
+        std::cout << "  (nothing captured)\n";
+    }
+}
+
+// round trip of a 64 byte udp message over loopback
+// echo by a blocking recv loop vs by BusyPoller, the ping side matches the echo side
+static void bench_busy_poll(){
+    Socket a = udp_peer(47100,47101);
+    Socket b = udp_peer(47101,47100);
+    std::atomic<bool> stop{false};
+    std::thread echo([&](){
+        ByteBuf buf;
+        buf.reserve(PING_SIZE);
+        b.set_read_timeout(std::chrono::milliseconds(100)).ignore();
+        while(!stop.load()){
+            buf.pop_back(buf.size());
+            auto ret = b.read_into(buf,PING_SIZE);
+            if(ret.check() && ret.ignore()>0){
+                b.write(buf).ignore();
+            }
+        }
+    });
+    std::vector<double> lat;
+    bool blocking = ping(a,false,lat);
+    stop.store(true);
+    echo.join();
+
+    std::cout << "busy_poll: udp loopback ping-pong, " << PING_SIZE << " bytes, " << PING_ROUNDS << " rounds\n";
+    if(blocking){
+        print_latency("blocking recv:",lat);
+    }
+
+    // the poller and the ping side each spin on a core of their own
+    if(std::thread::hardware_concurrency()<2){
+        std::cout << "  BusyPoller:    skipped, needs 2 cores\n";
+    }else{
+        BusyPoller poller(1);
+        poller.add(b,[](Socket& _sock,ByteBuf const& _buf){
+            if(_buf.size()){
+                _sock.write(_buf).ignore();
+            }
+        }).no_except("busy poll add");
+        if(poller.start().no_except("busy poll start")){
+            bool spinning = ping(a,true,lat);
+            poller.stop();
+            if(spinning){
+                print_latency("BusyPoller:   ",lat);
+            }
+        }
+    }
+    a.close().ignore();
+    b.close().ignore();
+}
+
+#endif
+
+static const size_t DRAIN_BYTES = 1<<20;
+static const size_t DRAIN_STEP = 64;
+
+// drain a 1 MB buffer from the front in 64 byte steps
+// ArrBuf moves its read cursor, the baseline moves the rest of the content
+// down on every pop, as pop_front did before the cursor
+static void bench_pop_front(){
+    std::string content(DRAIN_BYTES,'d');
+    ByteBuf buf(content);
+    size_t sum = 0;     // each pop reads its first byte, as a consumer would
+    auto start = Clock::now();
+    while(buf.size()){
+        sum += buf[0];
+        buf.pop_front(DRAIN_STEP<buf.size()?DRAIN_STEP:buf.size());
+    }
+    double cursor_ms = ns_since(start,1)/1e6;
+
+    std::string base = content;
+    size_t left = base.size();
+    start = Clock::now();
+    while(left){
+        size_t step = DRAIN_STEP<left?DRAIN_STEP:left;
+        sum += (Byte)base[0];
+        ::memmove(base.data(),base.data()+step,left-step);
+        left -= step;
+    }
+    double move_ms = ns_since(start,1)/1e6;
+    std::cout << "pop_front: drain " << DRAIN_BYTES << " bytes in " << DRAIN_STEP << " byte pops (checksum " << sum << ")\n"
+        << "  memmove per pop: " << move_ms << " ms\n"
+        << "  ArrBuf cursor:   " << cursor_ms << " ms\n";
+}
+
+static const int PIPE_ROUNDS = 20000;
+static const size_t PIPE_CAP_BYTES = 4<<20;
+static const uint64_t PIPE_CAP_RATE = 10<<20;
+static const int PIPE_MESSAGES = 10000;
+
+// ByteBuf(std::string) stops at the first zero byte, this copies all _size bytes
+static ByteBuf raw_bytes(void const* _data,size_t _size){
+    ByteBuf res;
+    res.ArrBuf<Byte>::push_back((Byte const*)_data,_size);
+    return res;
+}
+
+// 64 byte ping-pong between _a and an echo thread on _b, ns per round trip
+// _T is MemPipe or Socket, both have write and read_into
+template<typename _T>
+static double pipe_ping(_T& _a,_T& _b){
+    std::thread echo([&_b](){
+        Byte buf[PING_SIZE];
+        for(int i = 0;i<PIPE_ROUNDS;i++){
+            int got = 0;
+            while(got<PING_SIZE){
+                int n = _b.read_into(std::span<Byte>(buf+got,PING_SIZE-got)).ignore();
+                if(n<=0) return;
+                got += n;
+            }
+            _b.write(raw_bytes(buf,PING_SIZE)).ignore();
+        }
+    });
+    ByteBuf msg(std::string(PING_SIZE,'p'));
+    Byte buf[PING_SIZE];
+    auto start = Clock::now();
+    for(int i = 0;i<PIPE_ROUNDS;i++){
+        _a.write(msg).no_except("pipe ping write");
+        int got = 0;
+        while(got<PING_SIZE){
+            int n = _a.read_into(std::span<Byte>(buf+got,PING_SIZE-got)).ignore();
+            if(n<=0) break;
+            got += n;
+        }
+    }
+    double ns = ns_since(start,PIPE_ROUNDS);
+    echo.join();
+    return ns;
+}
+
+// the 4 byte sequence numbers that come out of a pipe with _imp,
+// after PIPE_MESSAGES numbered writes
+static std::vector<uint32_t> pipe_sequence(Impairment const& _imp){
+    auto pair_res = MemPipe::pair(PIPE_MESSAGES*sizeof(uint32_t),_imp);
+    auto& pipes = pair_res.except("mempipe pair");
+    MemPipe& a = std::get<0>(pipes);
+    MemPipe& b = std::get<1>(pipes);
+    for(uint32_t i = 0;i<(uint32_t)PIPE_MESSAGES;i++){
+        a.write(raw_bytes(&i,sizeof(i))).no_except("mempipe seq write");
+    }
+    a.shutdown(Socket::ShutdownType::SDT_SEND).ignore();
+    std::vector<uint32_t> res;
+    uint32_t id;
+    while(b.read_into(std::span<Byte>((Byte*)&id,sizeof(id))).ignore() == sizeof(id)){
+        res.push_back(id);
+    }
+    return res;
+}
+
+// MemPipe as a benchmark transport: ping-pong against a socketpair,
+// the bandwidth cap, and a seeded loss / reorder run that must replay exactly
+// return false if the replay differs
+static bool bench_mempipe(){
+    std::cout << "mempipe: " << PING_SIZE << " byte ping-pong, " << PIPE_ROUNDS << " rounds\n";
+    {
+        auto pair_res = MemPipe::pair();
+        auto& pipes = pair_res.except("mempipe pair");
+        std::cout << "  MemPipe:    " << pipe_ping(std::get<0>(pipes),std::get<1>(pipes)) << " ns per round trip\n";
+    }
+#ifdef __linux__
+    {
+        auto pair_res = Socket::pair();
+        auto& socks = pair_res.except("socketpair");
+        std::cout << "  socketpair: " << pipe_ping(std::get<0>(socks),std::get<1>(socks)) << " ns per round trip\n";
+    }
+#endif
+
+    {
+        Impairment imp;
+        imp.bandwidth = PIPE_CAP_RATE;
+        auto pair_res = MemPipe::pair(1<<20,imp);
+        auto& pipes = pair_res.except("mempipe pair");
+        MemPipe& a = std::get<0>(pipes);
+        MemPipe& b = std::get<1>(pipes);
+        std::thread writer([&a](){
+            ByteBuf chunk(std::string(64<<10,'b'));
+            for(size_t sent = 0;sent<PIPE_CAP_BYTES;sent += chunk.size()){
+                a.write_all(chunk).no_except("mempipe cap write");
+            }
+        });
+        std::vector<Byte> buf(64<<10);
+        size_t got = 0;
+        auto start = Clock::now();
+        while(got<PIPE_CAP_BYTES){
+            int n = b.read_into(std::span<Byte>(buf)).ignore();
+            if(n<=0) break;
+            got += n;
+        }
+        double ms = ns_since(start,1)/1e6;
+        writer.join();
+        std::cout << "  bandwidth cap " << (PIPE_CAP_RATE>>20) << " MB/s: " << got << " bytes in " << ms << " ms, "
+            << (double)got/(1<<20)/(ms/1e3) << " MB/s\n";
+    }
+
+    Impairment imp;
+    imp.loss = 0.05;
+    imp.reorder = 0.05;
+    imp.seed = 42;
+    std::vector<uint32_t> first = pipe_sequence(imp);
+    std::vector<uint32_t> again = pipe_sequence(imp);
+    imp.seed = 43;
+    std::vector<uint32_t> other = pipe_sequence(imp);
+    size_t reordered = 0;
+    for(size_t i = 1;i<first.size();i++){
+        if(first[i]<first[i-1]) reordered++;
+    }
+    bool replayed = first == again;
+    std::cout << "  loss 5%, reorder 5%, seed 42: " << PIPE_MESSAGES-first.size() << " of " << PIPE_MESSAGES
+        << " dropped, " << reordered << " reordered\n"
+        << "  same seed replays the same sequence: " << (replayed?"yes":"NO") << '\n'
+        << "  seed 43 gives another sequence: " << (first != other?"yes":"no") << '\n';
+    return replayed;
+}
+
+static const int CALL_ROUNDS = 100000000;
+
+// the Result layout at the baseline: the ok flag, the data and a call info
+// of three strings, time, function and file, with a user-declared destructor
+struct OldCallInfo{
+    std::string time = "";
+    std::string func = "";
+    std::string file = "";
+    int line = 0;
+    int ec = 0;
+};
+template<typename T>
+struct OldResult{
+    bool result = false;
+    T data;
+    OldCallInfo call_info;
+    ~OldResult(){}
+};
+
+[[gnu::noinline]] static OldResult<int> old_call(int _i){
+    return OldResult<int>{true,_i,OldCallInfo()};
+}
+[[gnu::noinline]] static Result<int> new_call(int _i){
+    return Result<int>(true,std::move(_i));
+}
+
+// cost of returning a successful Result<int> from a call that is not inlined
+static void bench_result_layout(){
+    long long sum = 0;
+    auto start = Clock::now();
+    for(int i = 0;i<CALL_ROUNDS;i++){
+        auto res = old_call(i);
+        if(res.result) sum += res.data;
+    }
+    double old_ns = ns_since(start,CALL_ROUNDS);
+    start = Clock::now();
+    for(int i = 0;i<CALL_ROUNDS;i++){
+        auto res = new_call(i);
+        if(res.check()) sum += res.ignore();
+    }
+    double new_ns = ns_since(start,CALL_ROUNDS);
+    std::cout << "result_layout: " << CALL_ROUNDS << " calls returning an ok Result<int> (checksum " << sum << ")\n"
+        << "  old layout, " << sizeof(OldResult<int>) << " bytes: " << old_ns << " ns per call\n"
+        << "  Result<int>, " << sizeof(Result<int>) << " bytes: " << new_ns << " ns per call\n";
+}
+
+int main(int argc,char** argv){
+    std::string only = argc>1?argv[1]:"";
+#ifdef __linux__
+    if(only.empty() || only == "call_pos") bench_call_pos();
+    if(only.empty() || only == "busy_poll") bench_busy_poll();
+#endif
+    if(only.empty() || only == "pop_front") bench_pop_front();
+    if(only.empty() || only == "result_layout") bench_result_layout();
+    bool ok = true;
+    if(only.empty() || only == "mempipe") ok = bench_mempipe() && ok;
+    return ok?0:1;
+}
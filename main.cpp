@@ -52,8 +52,8 @@ void tcp_server(){
             auto read_all_res = remote.readall(10,std::chrono::milliseconds(5000));
             if(!read_all_res.check()){
                 std::cout << "readall error"<<Socket::fast_err()<<'\n';
-                remote.shutdown();
-                remote.close();
+                remote.shutdown().ignore();
+                remote.close().ignore();
                 goto close_sock;
             }else{
                 auto& msg = read_all_res.ignore();
@@ -0,0 +1,250 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_ACCEPTOR_HPP__
+#define __TMC_ACCEPTOR_HPP__
+
+#include "tmc_Socket.hpp"
+
+#ifdef __linux__
+#include <linux/filter.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// max connections taken by one accept_batch of a worker
+#ifndef TMC_ACCEPT_BATCH
+#define TMC_ACCEPT_BATCH 64
+#endif
+
+namespace TMC{
+
+#ifdef __linux__
+
+// n listeners on the same address with SO_REUSEPORT
+// the kernel spreads new connections over them, each one has its own worker
+// thread, so accepting is no longer a single serial queue
+class Acceptor{
+public:
+    // called on the worker thread of the listener that took the connection
+    typedef std::function<void(Socket&&,size_t)> Callback;
+private:
+    // shared with the workers, stop raises the flag and signals the eventfd
+    struct _Stop{
+        std::atomic<bool> flag{false};
+        int efd = -1;
+        ~_Stop(){
+            if(efd != -1) ::close(efd);
+        }
+    };
+
+    std::vector<Socket> listeners_;
+    std::vector<std::thread> workers_;
+    std::shared_ptr<_Stop> stop_;
+
+    Acceptor()noexcept {}//hide
+
+    static void __work(Socket _listener,size_t _shard,std::shared_ptr<_Stop> _stop,Callback _cb){
+        std::vector<Socket> accepted;
+        accepted.reserve(TMC_ACCEPT_BATCH);
+        pollfd fds[2];
+        fds[0].fd = _listener.native_handle();
+        fds[0].events = POLLIN;
+        fds[1].fd = _stop->efd;
+        fds[1].events = POLLIN;
+        while(!_stop->flag.load(std::memory_order_relaxed)){
+            // the listener is left alone, stop wakes this up through the eventfd
+            int ret = ::poll(fds,2,-1);
+            if(ret == SOCKET_ERROR){
+                if(sys_errno() == EINTR) continue;
+                break;
+            }
+            if((fds[1].revents & POLLIN) || _stop->flag.load(std::memory_order_relaxed)){
+                break;
+            }
+            if(fds[0].revents & (POLLERR|POLLNVAL)){
+                break;  // the listener is gone
+            }
+            accepted.clear();
+            auto acc_res = _listener.accept_batch(accepted,TMC_ACCEPT_BATCH);
+            if(!acc_res.check()){
+                int ec = acc_res.error_code();
+                if(ec == EMFILE || ec == ENFILE || ec == ENOBUFS || ec == ENOMEM){
+                    // out of resources, the connection stays queued, retry a bit later
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    continue;
+                }
+                if(ec != EPROTO && ec != EPERM){
+                    break;  // the listener is unusable
+                }
+            }
+            for(auto& sock:accepted){
+                _cb(std::move(sock),_shard);
+            }
+        }
+    }
+
+    void __close(){
+        stop();
+        for(auto& l:listeners_){
+            l.close().ignore();
+        }
+        listeners_.clear();
+    }
+
+public:
+    Acceptor(Acceptor const&) = delete;
+    Acceptor& operator=(Acceptor const&) = delete;
+    Acceptor(Acceptor &&) = default;
+    Acceptor& operator=(Acceptor && other) noexcept{
+        if(this != &other){
+            __close();
+            listeners_ = std::move(other.listeners_);
+            workers_ = std::move(other.workers_);
+            stop_ = std::move(other.stop_);
+        }
+        return *this;
+    }
+    ~Acceptor(){
+        __close();
+    }
+
+    // open _shards listeners bound to _addr
+    // param _backlog listen queue length of each listener
+    // param _profile applied to every listener, reuseport is always on
+    static Result<Acceptor> create(IPAddr const& _addr,size_t _shards = std::thread::hardware_concurrency(),int _backlog = SOMAXCONN,SocketProfile _profile = SocketProfile()){
+        Acceptor res;
+        res.stop_ = std::make_shared<_Stop>();
+        res.stop_->efd = ::eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+        if(res.stop_->efd == -1){
+            return Result<Acceptor>(false,std::move(res),TMC_R_CALL_POS(sys_errno()));
+        }
+        _profile.reuseport = 1;
+        if(!_shards){
+            _shards = 1;
+        }
+        for(size_t i = 0;i<_shards;i++){
+            auto sock_res = Socket::create(Socket::Protocol::TCP,_profile);
+            if(!sock_res.check()){
+                return Result<Acceptor>(false,std::move(res),TMC_R_CALL_POS(sock_res.error_code()));
+            }
+            Socket& sock = sock_res.ignore();
+            res.listeners_.push_back(sock);
+            Result<void> step = sock.set_reuse_addr(true);
+            if(step.check()) step = sock.set_nonblocking(true);
+            if(step.check()) step = sock.bind(_addr);
+            if(step.check()) step = sock.listen(_backlog);
+            if(!step.check()){
+                return Result<Acceptor>(false,std::move(res),TMC_R_CALL_POS(step.error_code()?step.error_code():sys_errno()));
+            }
+        }
+        return Result<Acceptor>(true,std::move(res));
+    }
+
+    // count of listeners
+    size_t size()const noexcept{
+        return listeners_.size();
+    }
+
+    Socket const& listener(size_t pos)const{
+        return listeners_[pos];
+    }
+
+    // hand each connection to the listener of the cpu that got its packets
+    // with start(cb,true) the connection then stays on the core that accepted it
+    // needs one shard per cpu, else cpu c would land on a worker pinned elsewhere,
+    // fails with EINVAL otherwise
+    Result<void> steer_by_cpu(){
+        if(listeners_.empty() || listeners_.size() != std::thread::hardware_concurrency()){
+            return {false,TMC_R_CALL_POS(EINVAL)};
+        }
+        sock_filter code[] = {
+            {BPF_LD|BPF_W|BPF_ABS,0,0,(uint32_t)(SKF_AD_OFF+SKF_AD_CPU)},  // A = cpu
+            {BPF_ALU|BPF_MOD|BPF_K,0,0,(uint32_t)listeners_.size()},      // A %= n
+            {BPF_RET|BPF_A,0,0,0},                                          // index of the listener
+        };
+        sock_fprog prog;
+        prog.len = sizeof(code)/sizeof(code[0]);
+        prog.filter = code;
+        // attached once, applies to the whole reuseport group
+        int ret = ::setsockopt(listeners_[0].native_handle(),SOL_SOCKET,SO_ATTACH_REUSEPORT_CBPF,&prog,sizeof(prog));
+        return {ret != SOCKET_ERROR,TMC_R_CALL_POS(ret != SOCKET_ERROR?0:sys_errno())};
+    }
+
+    // start one worker thread per listener
+    // param _pin_cpus pin worker i to cpu i, use with steer_by_cpu
+    Result<void> start(Callback const& _cb,bool _pin_cpus = false){
+        if(!workers_.empty()){
+            return {false,TMC_R_CALL_POS(EALREADY)};
+        }
+        stop_->flag.store(false);
+        unsigned cpus = std::thread::hardware_concurrency();
+        for(size_t i = 0;i<listeners_.size();i++){
+            workers_.emplace_back(__work,listeners_[i],i,stop_,_cb);
+            if(_pin_cpus && cpus){
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i%cpus,&set);
+                int ec = ::pthread_setaffinity_np(workers_.back().native_handle(),sizeof(set),&set);
+                if(ec){
+                    stop();
+                    return {false,TMC_R_CALL_POS(ec)};
+                }
+            }
+        }
+        return true;
+    }
+
+    // stop and join the workers, the listeners stay open and start can be called again
+    void stop(){
+        if(workers_.empty()){
+            return;
+        }
+        stop_->flag.store(true);
+        uint64_t one = 1;
+        while(::write(stop_->efd,&one,sizeof(one)) == -1 && sys_errno() == EINTR);
+        for(auto& w:workers_){
+            w.join();
+        }
+        workers_.clear();
+        uint64_t count;
+        while(::read(stop_->efd,&count,sizeof(count)) == -1 && sys_errno() == EINTR);
+    }
+};
+
+#endif
+
+}
+
+
+#endif
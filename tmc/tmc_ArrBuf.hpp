@@ -34,6 +34,7 @@ SOFTWARE.
 
 
 #include <cstdint>
+#include <cstring>
 #include <atomic>
 
 namespace TMC{
@@ -43,6 +44,9 @@ template<typename _Type> class ArrBuf_Iter_Const;
 
 constexpr size_t arrbuf_max_size = ~0ULL - 1;
 
+// bytes kept inside an ArrBuf before it allocates
+#define TMC_ARRBUF_INLINE_BYTES 48
+
 template<typename _Type>
 class ArrBuf_Iter{
     friend class ArrBuf<_Type>;
@@ -142,10 +146,47 @@ public:
 template<typename _Type>
 class ArrBuf{
     friend class ArrBuf_Iter<_Type>;
+    // small content lives in inline_, data points there until it grows
+    static constexpr size_t inline_size_ = TMC_ARRBUF_INLINE_BYTES/sizeof(_Type)?TMC_ARRBUF_INLINE_BYTES/sizeof(_Type):1;
 private:
-    _Type* data = nullptr;  // aways the same as capacity
+    _Type inline_[inline_size_];
+    _Type* data = inline_;  // aways the same as capacity
+    size_t head_ = 0;       // the content starts here, pop_front only moves it
     size_t size_ = 0;
-    size_t capacity = 0;
+    size_t capacity = inline_size_;
+
+    bool _on_heap()const noexcept{
+        return data != inline_;
+    }
+    // take over the content of other, which is left empty
+    void _steal(ArrBuf& other) noexcept{
+        if(other._on_heap()){
+            data = other.data;
+            head_ = other.head_;
+            capacity = other.capacity;
+        }else{
+            memcpy(inline_,other.data+other.head_,other.size_*sizeof(_Type));
+            data = inline_;
+            head_ = 0;
+            capacity = inline_size_;
+        }
+        size_ = other.size_;
+        other.data = other.inline_;
+        other.head_ = 0;
+        other.size_ = 0;
+        other.capacity = inline_size_;
+    }
+    // copy the content of other, keeping its capacity
+    void _copy(ArrBuf const& other){
+        if(other.capacity>inline_size_){
+            data = new _Type[other.capacity];
+            capacity = other.capacity;
+        }
+        if(other.size_){
+            memcpy(data,other.data+other.head_,other.size_*sizeof(_Type));
+        }
+        size_ = other.size_;
+    }
 
     size_t _pre_grow_capacity(size_t _capacity) noexcept{
         if(_capacity==0){
@@ -156,42 +197,63 @@ private:
         _capacity = _capacity>arrbuf_max_size? arrbuf_max_size:_capacity;
         return _capacity;
     }
+    size_t _grown_capacity(size_t _size) noexcept{
+        size_t _capacity = capacity;
+        while(_capacity<_size){
+            _capacity = _pre_grow_capacity(_capacity);
+        }
+        return _capacity;
+    }
+    // the content moves to the front of the new memory
     void _apply_grow_capacity(size_t _capacity){
         _Type* new_data  = new _Type[_capacity];
-        if(data && size_){
-            memcpy(new_data,data,size_);
+        if(size_){
+            memcpy(new_data,data+head_,size_*sizeof(_Type));
+        }
+        if(_on_heap()){
             delete[] data;
-            data = nullptr;
         }
         data = new_data;
+        head_ = 0;
         capacity = _capacity;
     }
+    // make spare_size() at least _size
+    // the content is moved to the front only if what was popped is
+    // at least as large as the content, so pops cost O(1) amortized
+    // else the memory grows, to exactly what is needed if _exact
+    void _tail_room(size_t _size,bool _exact){
+        if(capacity-head_-size_>=_size){
+            return;
+        }
+        size_t need = size_+_size;
+        if(head_>=size_ && need<=capacity){
+            memmove(data,data+head_,size_*sizeof(_Type));
+            head_ = 0;
+            return;
+        }
+        if(need<=capacity){
+            _apply_grow_capacity(_pre_grow_capacity(capacity));
+        }else{
+            _apply_grow_capacity(_exact?need:_grown_capacity(need));
+        }
+    }
 protected:
     void _reset(){
-        if(data){
+        if(_on_heap()){
             delete[] data;
-            data =nullptr;
         }
+        data = inline_;
+        head_ = 0;
         size_ = 0;
-        capacity =0;
+        capacity = inline_size_;
     }
 public:
     ArrBuf() noexcept {}
     ArrBuf(ArrBuf const& other){
-        this->size_ = other.size_;
-        this->capacity = other.capacity;
-        if(other.capacity){
-            this->data = new _Type[other.capacity];
-        }
-        if(other.size_){
-            memcpy(this->data,other.data,size_);
-        }
+        _copy(other);
     }
     ArrBuf(ArrBuf&& other) noexcept {
-        std::swap(this->capacity,other.capacity);
-        std::swap(this->size_,other.size_);
-        this->data = other.data;
-        other.data = nullptr;
+        _steal(other);
     }
     ArrBuf(_Type const* _data,size_t _size){
         push_back(_data,_size);
@@ -203,75 +265,95 @@ public:
         _reset();
     }
     ArrBuf& operator=(ArrBuf const& other){
-        _reset();
-        this->size_ = other.size_;
-        this->capacity = other.capacity;
-        if(other.capacity){
-            this->data = new _Type[other.capacity];
-        }
-        if(other.size_){
-            memcpy(this->data,other.data,size_);
+        if(this == &other){
+            return *this;
         }
+        _reset();
+        _copy(other);
         return *this;
     }
     ArrBuf& operator=(ArrBuf && other) noexcept{
-        std::swap(this->capacity,other.capacity);
-        std::swap(this->size_,other.size_);
-        char* temp = this->data;
-        this->data = other.data;
-        other.data = temp;
+        if(this == &other){
+            return *this;
+        }
+        _reset();
+        _steal(other);
         return *this;
     }
     _Type& operator[](size_t pos){
-        return data[pos];
+        return data[head_+pos];
     }
     _Type const& operator[](size_t pos) const{
-        return data[pos];
+        return data[head_+pos];
     }
     void push_back(_Type const* _data, size_t _size){
-        size_t after_size = _size+size_;
-
-        size_t _capacity = capacity;
-        while(_capacity<after_size){
-            _capacity = _pre_grow_capacity(_capacity);
-        }
-        if(_capacity!=capacity){
-            _apply_grow_capacity(_capacity);
-        }
-        memcpy(data+size_,_data,_size);
-        size_ = after_size;
+        _tail_room(_size,false);
+        memcpy(data+head_+size_,_data,_size*sizeof(_Type));
+        size_ += _size;
     }
     void push_back(_Type const& _data){
         push_back(&_data,1);
     }
     void pop_back(size_t _size){
         size_ = _size>size_?0:size_-_size;
+        if(!size_){
+            head_ = 0;
+        }
     }
+    // O(1) if that much was popped from the front before, else the content shifts
     void push_front(_Type const* _data, size_t _size){
-        size_t after_size = _size+size_;
-        size_t _capacity = capacity;
-        while(_capacity<after_size){
-            _capacity = _pre_grow_capacity(_capacity);
+        if(head_>=_size){
+            head_ -= _size;
+            memcpy(data+head_,_data,_size*sizeof(_Type));
+            size_ += _size;
+            return;
         }
-        if(_capacity!=capacity){
-            _apply_grow_capacity(_capacity);
+        size_t after_size = _size+size_;
+        if(after_size>capacity){
+            _apply_grow_capacity(_grown_capacity(after_size));
         }
-        memcpy(data+_size,data,size_);
-        memcpy(data,_data,_size);
+        memmove(data+_size,data+head_,size_*sizeof(_Type));
+        memcpy(data,_data,_size*sizeof(_Type));
+        head_ = 0;
         size_ = after_size;
     }
     void push_front(_Type const& _data){
         push_front(&_data,1);
     }
+    // O(1), only the start of the content moves
     void pop_front(size_t _size){
-        size_t after_size = _size>size_?0:size_-_size;
-        if(after_size){
-            memcpy(data,data+_size,after_size);
+        if(_size>=size_){
+            head_ = 0;
+            size_ = 0;
+            return;
         }
-        size_ = after_size;
+        head_ += _size;
+        size_ -= _size;
     }
     _Type const* view()const noexcept{
-        return data;
+        return data+head_;
+    }
+    // make room for at least _capacity elements, size is not changed
+    void reserve(size_t _capacity){
+        if(_capacity>size_){
+            _tail_room(_capacity-size_,true);
+        }
+    }
+    // writable space after the last element, fill it then call commit
+    _Type* spare() noexcept{
+        return data+head_+size_;
+    }
+    size_t spare_size()const noexcept{
+        return capacity-head_-size_;
+    }
+    // take _size elements written into spare() as content
+    void commit(size_t _size) noexcept{
+        size_ += _size>spare_size()?spare_size():_size;
+    }
+    // true while the content is stored inside the object
+    // moving such a buffer copies it, so pointers into it do not survive a move
+    bool is_inline()const noexcept{
+        return !_on_heap();
     }
     size_t size()const noexcept{
         return size_;
@@ -0,0 +1,191 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_BUFFERCHAIN_HPP__
+#define __TMC_BUFFERCHAIN_HPP__
+
+#include "tmc_ByteBuf.hpp"
+#include "tmc_ByteView.hpp"
+
+#include <deque>
+#include <span>
+
+namespace TMC{
+
+// a list of byte segments sent or received with one syscall
+// segments point into ByteBufs or spans, nothing is copied
+// a ByteBuf passed by const& or a span must outlive the chain and stay in place
+// a ByteBuf passed by && is kept inside the chain
+// a ByteView is held by the chain, so one payload can sit in many chains
+class BufferChain{
+public:
+    struct Segment{
+        Byte* data;
+        size_t size;
+        bool owned = false;     // points into owned_
+        bool shared = false;    // points into views_
+        bool writable = false;  // pushed as std::span<Byte>, read_into may fill it
+    };
+private:
+    std::deque<Segment> segs_;
+    std::deque<ByteBuf> owned_;
+    std::deque<ByteView> views_;
+    size_t bytes_ = 0;
+
+    static Segment __seg(Byte const* _data,size_t _size) noexcept{
+        // the cast only unifies storage, writable stays false so nothing writes through it
+        return Segment{const_cast<Byte*>(_data),_size};
+    }
+
+public:
+    BufferChain()noexcept {}
+    // segments may point into owned_, a copy would point into the source
+    BufferChain(BufferChain const&) = delete;
+    BufferChain& operator=(BufferChain const&) = delete;
+    BufferChain(BufferChain &&) = default;
+    BufferChain& operator=(BufferChain &&) = default;
+    BufferChain(std::initializer_list<std::span<Byte const>> _segs){
+        for(auto const& seg:_segs){
+            push_back(seg);
+        }
+    }
+
+    // write only, the content is not modified
+    void push_back(ByteBuf const& _buf){
+        push_back(std::span<Byte const>(_buf.view(),_buf.size()));
+    }
+    void push_back(ByteBuf&& _buf){
+        if(!_buf.size()) return;
+        owned_.push_back(std::move(_buf));
+        push_back(owned_.back());
+        segs_.back().owned = true;
+    }
+    // the view is shared with other chains, its segment is never writable
+    // so read_into refuses the chain instead of writing into the payload
+    void push_back(ByteView const& _view){
+        if(!_view.size()) return;
+        views_.push_back(_view);
+        push_back(_view.span());
+        segs_.back().shared = true;
+    }
+    void push_back(std::span<Byte const> _seg){
+        if(!_seg.size()) return;
+        segs_.push_back(__seg(_seg.data(),_seg.size()));
+        bytes_ += _seg.size();
+    }
+    // writable segment, can be the target of Socket::read_into
+    void push_back(std::span<Byte> _seg){
+        if(!_seg.size()) return;
+        segs_.push_back(Segment{_seg.data(),_seg.size(),false,false,true});
+        bytes_ += _seg.size();
+    }
+
+    void push_front(ByteBuf const& _buf){
+        push_front(std::span<Byte const>(_buf.view(),_buf.size()));
+    }
+    void push_front(ByteBuf&& _buf){
+        if(!_buf.size()) return;
+        owned_.push_front(std::move(_buf));
+        push_front(owned_.front());
+        segs_.front().owned = true;
+    }
+    void push_front(ByteView const& _view){
+        if(!_view.size()) return;
+        views_.push_front(_view);
+        push_front(_view.span());
+        segs_.front().shared = true;
+    }
+    void push_front(std::span<Byte const> _seg){
+        if(!_seg.size()) return;
+        segs_.push_front(__seg(_seg.data(),_seg.size()));
+        bytes_ += _seg.size();
+    }
+    void push_front(std::span<Byte> _seg){
+        if(!_seg.size()) return;
+        segs_.push_front(Segment{_seg.data(),_seg.size(),false,false,true});
+        bytes_ += _seg.size();
+    }
+
+    // drop _size bytes from the front, e.g. after a partial write
+    // owned ByteBufs and held views are released once fully dropped
+    void pop_front(size_t _size){
+        while(_size && !segs_.empty()){
+            Segment& seg = segs_.front();
+            if(_size<seg.size){
+                seg.data += _size;
+                seg.size -= _size;
+                bytes_ -= _size;
+                return;
+            }
+            _size -= seg.size;
+            bytes_ -= seg.size;
+            if(seg.owned){
+                owned_.pop_front();     // owned_ keeps the order of the owned segments
+            }else if(seg.shared){
+                views_.pop_front();
+            }
+            segs_.pop_front();
+        }
+    }
+
+    // count of segments
+    size_t count()const noexcept{
+        return segs_.size();
+    }
+    // count of bytes in all segments
+    size_t size()const noexcept{
+        return bytes_;
+    }
+    Segment const& operator[](size_t pos)const{
+        return segs_[pos];
+    }
+    // true if every segment was pushed as std::span<Byte>
+    bool writable()const noexcept{
+        for(auto const& seg:segs_){
+            if(!seg.writable) return false;
+        }
+        return true;
+    }
+    void clear(){
+        segs_.clear();
+        owned_.clear();
+        views_.clear();
+        bytes_ = 0;
+    }
+
+    // copy all segments into one ByteBuf
+    ByteBuf flatten()const{
+        ByteBuf res;
+        for(auto const& seg:segs_){
+            res.ArrBuf<Byte>::push_back(seg.data,seg.size);
+        }
+        return res;
+    }
+};
+
+}
+
+#endif
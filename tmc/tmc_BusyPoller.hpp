@@ -0,0 +1,235 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_BUSYPOLLER_HPP__
+#define __TMC_BUSYPOLLER_HPP__
+
+#include "tmc_Socket.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+namespace TMC{
+
+#ifdef __linux__
+
+// spin receive loop for latency critical sockets, burns one core
+// non-blocking recv in a tight loop, no epoll / select / condition variable hop
+// messages go straight to the callback on the spinning thread
+class BusyPoller{
+public:
+    // an empty buf means the peer closed or the socket failed, it is dropped after
+    // on datagram sockets an empty datagram is just skipped
+    typedef std::function<void(Socket&,ByteBuf const&)> Callback;
+private:
+    struct _Entry{
+        Socket sock;
+        Callback cb;
+        bool stream = true;     // 0 bytes read means the peer closed
+    };
+
+    int cpu_ = -1;
+    int busy_poll_us_ = 0;
+    int budget_ = 0;
+    int read_size_ = 0;
+    std::vector<_Entry> entries_;
+    std::atomic<bool> need_stop_{false};
+    std::atomic<bool> pinned_{false};   // the thread of start waits for its affinity
+    std::thread thread_;
+
+    static void __relax() noexcept{
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    Result<void> __pin(pthread_t _thread){
+        if(cpu_<0){
+            return true;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu_,&set);
+        int ec = ::pthread_setaffinity_np(_thread,sizeof(set),&set);
+        return {ec == 0,TMC_R_CALL_POS(ec)};
+    }
+
+    static bool __is_stream(Socket& _sock){
+        switch(_sock.protocol()){
+        case Socket::Protocol::UDP:
+            return false;
+        case Socket::Protocol::P_OTHER:{
+            auto type_res = _sock.getopt<SO_TYPE>();
+            return !type_res.check() || type_res.ignore() != SOCK_DGRAM;
+        }
+        default:
+            return true;
+        }
+    }
+
+    void __loop(){
+        ByteBuf buf;
+        buf.reserve(read_size_);
+        while(!entries_.empty() && !need_stop_.load(std::memory_order_relaxed)){
+            bool got = false;
+            for(size_t i = 0;i<entries_.size();){
+                _Entry& e = entries_[i];
+                buf.pop_back(buf.size());
+                auto ret = e.sock.read_into(buf,read_size_);
+                if(ret.check() && ret.ignore()>0){
+                    e.cb(e.sock,buf);
+                    got = true;
+                    i++;
+                }else if(ret.check() && !e.stream){
+                    got = true;     // empty datagram
+                    i++;
+                }else if(!ret.check() && Socket::would_block(ret.error_code())){
+                    i++;
+                }else{
+                    // peer closed or failed
+                    buf.pop_back(buf.size());
+                    e.cb(e.sock,buf);
+                    entries_.erase(entries_.begin()+i);
+                }
+            }
+            if(!got){
+                __relax();
+            }
+        }
+    }
+
+public:
+    BusyPoller(BusyPoller const&) = delete;
+    BusyPoller& operator=(BusyPoller const&) = delete;
+
+    // param _cpu core the loop pins itself to, -1 does not pin
+    // param _busy_poll_us SO_BUSY_POLL, the kernel also spins on the nic queue
+    // param _budget SO_BUSY_POLL_BUDGET, packets per kernel busy poll, 0 keeps the default
+    // param _read_size max bytes per recv
+    BusyPoller(int _cpu = -1,int _busy_poll_us = 50,int _budget = 0,int _read_size = 65536)
+        :cpu_(_cpu)
+        ,busy_poll_us_(_busy_poll_us)
+        ,budget_(_budget)
+        ,read_size_(_read_size)
+    {}
+    ~BusyPoller(){
+        stop();
+    }
+
+    // spin on _sock too, call before start / run
+    // the socket is switched to non-blocking
+    // return ok(true) if the kernel busy polls it as well
+    // ok(false) if the kernel refused, e.g. raising SO_BUSY_POLL needs CAP_NET_ADMIN
+    Result<bool> add(Socket const& _sock,Callback const& _cb){
+        Socket sock = _sock;
+        auto nb_res = sock.set_nonblocking(true);
+        if(!nb_res.check()){
+            return Result<bool>(false,false,TMC_R_CALL_POS(nb_res.error_code()));
+        }
+        bool kernel_poll = false;
+        if(busy_poll_us_>0){
+            kernel_poll = sock.setopt<SO_BUSY_POLL>(busy_poll_us_).check();
+#ifdef SO_PREFER_BUSY_POLL
+            if(kernel_poll){
+                sock.setopt<SO_PREFER_BUSY_POLL>(1).ignore();
+                if(budget_>0){
+                    sock.setopt<SO_BUSY_POLL_BUDGET>(budget_).ignore();
+                }
+            }
+#endif
+        }
+        entries_.push_back(_Entry{sock,_cb,__is_stream(sock)});
+        return Result<bool>::ok(std::move(kernel_poll));
+    }
+
+    // count of sockets spun on
+    size_t size()const noexcept{
+        return entries_.size();
+    }
+
+    // spin on the calling thread until stop, or until every socket is dropped
+    Result<void> run(){
+        auto pin_res = __pin(::pthread_self());
+        if(!pin_res.check()){
+            return pin_res;
+        }
+        need_stop_.store(false);
+        __loop();
+        return true;
+    }
+
+    // run on a new thread, pinned before this returns
+    // a failed pin stops the thread and returns the error
+    Result<void> start(){
+        if(thread_.joinable()){
+            return {false,TMC_R_CALL_POS(EALREADY)};
+        }
+        need_stop_.store(false);
+        pinned_.store(false);
+        thread_ = std::thread([this](){
+            while(!pinned_.load(std::memory_order_acquire)){
+                __relax();
+            }
+            if(!need_stop_.load(std::memory_order_relaxed)){
+                __loop();
+            }
+        });
+        auto pin_res = __pin(thread_.native_handle());
+        if(!pin_res.check()){
+            need_stop_.store(true);
+        }
+        pinned_.store(true,std::memory_order_release);
+        if(!pin_res.check()){
+            thread_.join();
+        }
+        return pin_res;
+    }
+
+    // make run return, joins the thread of start
+    // can be called from a callback, then the thread is joined by a later stop
+    void stop(){
+        need_stop_.store(true);
+        if(thread_.joinable() && thread_.get_id() != std::this_thread::get_id()){
+            thread_.join();
+        }
+    }
+};
+
+#endif
+
+}
+
+
+#endif
@@ -47,14 +47,14 @@ public:
         push_back(str);
     }
     ByteBuf(ByteBuf const& other):ArrBuf<Byte>(other){}
-    ByteBuf(ByteBuf && other)noexcept :ArrBuf<Byte>(other){}
+    ByteBuf(ByteBuf && other)noexcept :ArrBuf<Byte>(std::move(other)){}
 
     ByteBuf& operator=(ByteBuf const& other){
         this->ArrBuf<Byte>::operator=(other);
         return *this;
     }
-    ByteBuf& operator=(ByteBuf && other){
-        this->ArrBuf<Byte>::operator=(other);
+    ByteBuf& operator=(ByteBuf && other)noexcept{
+        this->ArrBuf<Byte>::operator=(std::move(other));
         return *this;
     }
     ByteBuf& operator=(std::string const& str){
@@ -82,14 +82,12 @@ public:
     void push_front(Byte const* _data){
         ArrBuf::push_front(_data,strlen((char const*)_data));
     }
-    ByteBuf slice(size_t start_pos,size_t count = npos){
-        ByteBuf res = *this;
-        res.pop_front(start_pos);
-        if(count!=npos){
-            size_t res_size = res.size();
-            if(res_size>count){
-                res.pop_back(res_size-count);
-            }
+    // copy of the range, use ByteView::slice to share it instead
+    ByteBuf slice(size_t start_pos,size_t count = npos)const{
+        ByteBuf res;
+        if(start_pos<size()){
+            size_t left = size()-start_pos;
+            res.ArrBuf::push_back(view()+start_pos,count<left?count:left);
         }
         return res;
     }
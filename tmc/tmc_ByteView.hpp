@@ -0,0 +1,110 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_BYTEVIEW_HPP__
+#define __TMC_BYTEVIEW_HPP__
+
+#include "tmc_ByteBuf.hpp"
+
+#include <memory>
+#include <span>
+
+namespace TMC{
+
+// a read only range of a shared ByteBuf
+// the ByteBuf is frozen once it is handed over, every view and slice
+// of it points into the same memory and keeps it alive
+// copying, slicing and trimming never copy bytes
+// views can be passed between threads, only the count is shared
+class ByteView{
+private:
+    std::shared_ptr<ByteBuf const> owner_;
+    Byte const* data_ = nullptr;
+    size_t size_ = 0;
+
+    ByteView(std::shared_ptr<ByteBuf const> const& _owner,Byte const* _data,size_t _size)noexcept//hide
+        :owner_(_owner),data_(_data),size_(_size){}
+
+public:
+    ByteView()noexcept {}
+    // take over _buf, one allocation for the shared count
+    explicit ByteView(ByteBuf&& _buf)
+        :owner_(std::make_shared<ByteBuf const>(std::move(_buf))){
+        data_ = owner_->view();
+        size_ = owner_->size();
+    }
+
+    // the range [_start,_start+_count), cut to what this view has
+    ByteView slice(size_t _start,size_t _count = npos)const noexcept{
+        if(_start>=size_){
+            return ByteView();
+        }
+        size_t left = size_-_start;
+        return ByteView(owner_,data_+_start,_count<left?_count:left);
+    }
+
+    // drop from the front, e.g. after a frame was parsed
+    void pop_front(size_t _size)noexcept{
+        _size = _size<size_?_size:size_;
+        data_ += _size;
+        size_ -= _size;
+    }
+    void pop_back(size_t _size)noexcept{
+        size_ = _size<size_?size_-_size:0;
+    }
+
+    Byte const* view()const noexcept{
+        return data_;
+    }
+    size_t size()const noexcept{
+        return size_;
+    }
+    bool empty()const noexcept{
+        return !size_;
+    }
+    Byte const& operator[](size_t pos)const noexcept{
+        return data_[pos];
+    }
+    std::span<Byte const> span()const noexcept{
+        return std::span<Byte const>(data_,size_);
+    }
+    // views sharing the storage, 0 for an empty view
+    long use_count()const noexcept{
+        return owner_.use_count();
+    }
+
+    // copy the range into a ByteBuf of its own
+    ByteBuf to_buf()const{
+        ByteBuf res;
+        res.ArrBuf<Byte>::push_back(data_,size_);
+        return res;
+    }
+};
+
+}
+
+
+#endif
@@ -0,0 +1,422 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_CORO_HPP__
+#define __TMC_CORO_HPP__
+
+#include "tmc_Reactor.hpp"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <utility>
+
+namespace TMC{
+
+#ifdef __linux__
+
+class CoLoop;
+
+struct _TaskPromiseBase{
+    std::coroutine_handle<> continuation_ = std::noop_coroutine();
+    std::exception_ptr exception_;
+
+    // resume whoever awaited the task
+    struct _Final{
+        bool await_ready()noexcept{ return false; }
+        template<typename _Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<_Promise> _h)noexcept{
+            return _h.promise().continuation_;
+        }
+        void await_resume()noexcept{}
+    };
+
+    std::suspend_always initial_suspend()noexcept{ return {}; }
+    _Final final_suspend()noexcept{ return {}; }
+    void unhandled_exception()noexcept{
+        exception_ = std::current_exception();
+    }
+    void __rethrow(){
+        if(exception_){
+            std::rethrow_exception(exception_);
+        }
+    }
+};
+
+template<typename _Tp>
+struct _TaskPromise: _TaskPromiseBase{
+    std::optional<_Tp> value_;
+    template<typename _Val>
+    void return_value(_Val&& _val){
+        value_.emplace(std::forward<_Val>(_val));
+    }
+    _Tp __take(){
+        __rethrow();
+        return std::move(*value_);
+    }
+};
+template<>
+struct _TaskPromise<void>: _TaskPromiseBase{
+    void return_void()noexcept{}
+    void __take(){
+        __rethrow();
+    }
+};
+
+// a coroutine returning _Tp
+// lazy, it starts when co_awaited or spawned on a CoLoop
+// exceptions are thrown again from co_await
+template<typename _Tp = void>
+class Task{
+    friend class CoLoop;
+public:
+    struct promise_type: _TaskPromise<_Tp>{
+        Task get_return_object()noexcept{
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+private:
+    std::coroutine_handle<promise_type> h_;
+
+    explicit Task(std::coroutine_handle<promise_type> _h)noexcept:h_(_h){}//hide
+
+    struct _Awaiter{
+        std::coroutine_handle<promise_type> h_;
+        bool await_ready()noexcept{
+            return !h_ || h_.done();
+        }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> _awaiting)noexcept{
+            h_.promise().continuation_ = _awaiting;
+            return h_;
+        }
+        _Tp await_resume(){
+            return h_.promise().__take();
+        }
+    };
+public:
+    Task(Task const&) = delete;
+    Task& operator=(Task const&) = delete;
+    Task(Task && other)noexcept :h_(std::exchange(other.h_,nullptr)){}
+    Task& operator=(Task && other)noexcept{
+        if(this != &other){
+            if(h_) h_.destroy();
+            h_ = std::exchange(other.h_,nullptr);
+        }
+        return *this;
+    }
+    ~Task(){
+        if(h_) h_.destroy();
+    }
+
+    bool done()const noexcept{
+        return !h_ || h_.done();
+    }
+
+    _Awaiter operator co_await()noexcept{
+        return _Awaiter{h_};
+    }
+};
+
+// fire and forget coroutine frame behind CoLoop::spawn
+struct _Detached{
+    struct promise_type{
+        _Detached get_return_object()noexcept{ return {}; }
+        std::suspend_never initial_suspend()noexcept{ return {}; }
+        std::suspend_never final_suspend()noexcept{ return {}; }
+        void return_void()noexcept{}
+        void unhandled_exception()noexcept{ std::terminate(); }
+    };
+};
+
+// single thread event loop for coroutines
+// resumes the async_ functions of Socket through a Reactor
+// thousands of sessions can wait on one thread, no thread per connection
+// do not move a loop while coroutines wait on it
+class CoLoop: public AsyncDriver{
+private:
+    struct _Wait{
+        std::function<void(bool)> cb;
+        std::multimap<TimePoint,std::function<void()>>::iterator timer;
+        bool timed = false;
+    };
+    struct _FdWaits{
+        _Wait read;
+        _Wait write;
+        uint32_t events = 0;
+    };
+
+    // makes this loop the current driver while it runs code
+    struct _Current{
+        AsyncDriver* prev_;
+        _Current(AsyncDriver* _driver)noexcept :prev_(AsyncDriver::current()){
+            AsyncDriver::current() = _driver;
+        }
+        ~_Current(){
+            AsyncDriver::current() = prev_;
+        }
+    };
+
+    Reactor reactor_;
+    std::unordered_map<SOCKET,_FdWaits> fds_;
+    std::multimap<TimePoint,std::function<void()>> timers_;
+    size_t live_ = 0;           // spawned tasks not finished
+    bool need_stop_ = false;
+    std::exception_ptr error_;  // first exception out of a spawned task
+
+    CoLoop(Reactor&& _reactor)noexcept :reactor_(std::move(_reactor)){}//hide
+
+    // register the fd for the events its waits need
+    void __update(SOCKET _fd){
+        auto it = fds_.find(_fd);
+        if(it == fds_.end()){
+            return;
+        }
+        _FdWaits& w = it->second;
+        uint32_t events = 0;
+        if(w.read.cb) events |= Reactor::EV_READ;
+        if(w.write.cb) events |= Reactor::EV_WRITE;
+        if(events == w.events){
+            if(!events) fds_.erase(it);
+            return;
+        }
+        Result<void> res(true);
+        if(!events){
+            reactor_.remove(_fd).ignore();
+            fds_.erase(it);
+            return;
+        }else if(!w.events){
+            res = reactor_.add(_fd,events,[this,_fd](uint32_t ev){__on_ready(_fd,ev);});
+        }else{
+            res = reactor_.modify(_fd,events);
+        }
+        if(res.check()){
+            w.events = events;
+            return;
+        }
+        // cannot watch this fd, give the waits up as timed out
+        auto read_cb = __take(_fd,false);
+        auto write_cb = __take(_fd,true);
+        fds_.erase(_fd);
+        if(read_cb) read_cb(false);
+        if(write_cb) write_cb(false);
+    }
+
+    std::function<void(bool)> __take(SOCKET _fd,bool _write){
+        auto it = fds_.find(_fd);
+        if(it == fds_.end()){
+            return nullptr;
+        }
+        _Wait& wait = _write?it->second.write:it->second.read;
+        if(wait.timed){
+            timers_.erase(wait.timer);
+            wait.timed = false;
+        }
+        return std::exchange(wait.cb,nullptr);
+    }
+
+    void __on_ready(SOCKET _fd,uint32_t _events){
+        if(_events & (Reactor::EV_READ|Reactor::EV_ERROR|Reactor::EV_HUP)){
+            auto cb = __take(_fd,false);
+            if(cb) cb(true);
+        }
+        if(_events & (Reactor::EV_WRITE|Reactor::EV_ERROR|Reactor::EV_HUP)){
+            auto cb = __take(_fd,true);
+            if(cb) cb(true);
+        }
+        __update(_fd);
+    }
+
+    void __expire(SOCKET _fd,bool _write){
+        auto it = fds_.find(_fd);
+        if(it == fds_.end()){
+            return;
+        }
+        // the timer is already out of timers_
+        (_write?it->second.write:it->second.read).timed = false;
+        auto cb = __take(_fd,_write);
+        if(cb) cb(false);
+        __update(_fd);
+    }
+
+    // run the timers that are due
+    void __fire_timers(){
+        auto now = std::chrono::steady_clock::now();
+        while(!timers_.empty() && timers_.begin()->first<=now){
+            auto fn = std::move(timers_.begin()->second);
+            timers_.erase(timers_.begin());
+            fn();
+        }
+    }
+
+    static _Detached __detach(CoLoop* _loop,Task<void> _task){
+        try{
+            co_await _task;
+        }catch(...){
+            if(!_loop->error_){
+                _loop->error_ = std::current_exception();
+            }
+            _loop->need_stop_ = true;
+        }
+        _loop->live_--;
+    }
+
+public:
+    CoLoop(CoLoop const&) = delete;
+    CoLoop& operator=(CoLoop const&) = delete;
+    CoLoop(CoLoop &&) = default;
+    CoLoop& operator=(CoLoop &&) = default;
+
+    // create a loop
+    // param _max_events max events reaped by one epoll_wait
+    static Result<CoLoop> create(int _max_events = 1024){
+        auto reactor_res = Reactor::create(_max_events);
+        CoLoop res(std::move(reactor_res.ignore()));
+        return Result<CoLoop>(reactor_res.check(),std::move(res),TMC_R_CALL_POS(reactor_res.error_code()));
+    }
+
+    void wait(SOCKET _fd,short _events,TimePoint _deadline,std::function<void(bool)> _cb) override{
+        bool write = _events & POLLOUT;
+        _FdWaits& w = fds_[_fd];
+        _Wait& wait = write?w.write:w.read;
+        if(wait.timed){
+            timers_.erase(wait.timer);
+        }
+        wait.cb = std::move(_cb);
+        wait.timed = _deadline != TimePoint::max();
+        if(wait.timed){
+            wait.timer = timers_.emplace(_deadline,[this,_fd,write](){__expire(_fd,write);});
+        }
+        __update(_fd);
+    }
+
+    // suspend the calling coroutine for _duration
+    auto sleep(std::chrono::milliseconds const& _duration){
+        struct _Sleep{
+            CoLoop* loop_;
+            TimePoint at_;
+            bool await_ready()noexcept{
+                return at_<=std::chrono::steady_clock::now();
+            }
+            void await_suspend(std::coroutine_handle<> _h){
+                loop_->timers_.emplace(at_,[_h](){_h.resume();});
+            }
+            void await_resume()noexcept{}
+        };
+        return _Sleep{this,std::chrono::steady_clock::now()+_duration};
+    }
+
+    // start _task now, it runs on until its first suspension
+    // the loop keeps it alive until it finishes
+    void spawn(Task<void>&& _task){
+        _Current cur(this);
+        live_++;
+        __detach(this,std::move(_task));
+    }
+
+    // count of spawned tasks not finished yet
+    size_t size()const noexcept{
+        return live_;
+    }
+
+    // wait for io or timers once and resume the coroutines that are ready
+    // param _timeout < 0 wait forever, 0 return immediately
+    Result<int> poll_once(std::chrono::milliseconds const& _timeout){
+        _Current cur(this);
+        auto wait = _timeout;
+        if(!timers_.empty()){
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(timers_.begin()->first-std::chrono::steady_clock::now());
+            if(left.count()<0) left = std::chrono::milliseconds(0);
+            // round up, else a timer due in less than 1ms spins
+            if(timers_.begin()->first>std::chrono::steady_clock::now()+left) left += std::chrono::milliseconds(1);
+            if(wait.count()<0 || left<wait) wait = left;
+        }
+        auto res = reactor_.poll_once(wait);
+        __fire_timers();
+        return res;
+    }
+
+    // run until every spawned task finished or stop is called
+    // throws the first exception that escaped a spawned task
+    Result<void> run(){
+        need_stop_ = false;
+        while(!need_stop_ && live_){
+            auto res = poll_once(std::chrono::milliseconds(-1));
+            if(!res.check()){
+                return {false,TMC_R_CALL_POS(res.error_code())};
+            }
+        }
+        if(error_){
+            std::rethrow_exception(std::exchange(error_,nullptr));
+        }
+        return true;
+    }
+
+    // make run return after the current loop
+    void stop()noexcept{
+        need_stop_ = true;
+    }
+
+    // run the loop until _task finished and return its value
+    // other spawned tasks progress meanwhile
+    template<typename _Tp>
+    _Tp block_on(Task<_Tp> _task){
+        std::optional<std::conditional_t<std::is_void_v<_Tp>,bool,_Tp>> out;
+        std::exception_ptr err;
+        auto wrap = [](Task<_Tp> _t,decltype(out)* _out,std::exception_ptr* _err)->Task<void>{
+            try{
+                if constexpr(std::is_void_v<_Tp>){
+                    co_await _t;
+                    _out->emplace(true);
+                }else{
+                    _out->emplace(co_await _t);
+                }
+            }catch(...){
+                *_err = std::current_exception();
+            }
+        };
+        spawn(wrap(std::move(_task),&out,&err));
+        while(!out && !err){
+            poll_once(std::chrono::milliseconds(-1)).ignore();
+        }
+        if(err){
+            std::rethrow_exception(err);
+        }
+        if constexpr(!std::is_void_v<_Tp>){
+            return std::move(*out);
+        }
+    }
+};
+
+#endif
+
+}
+
+
+#endif
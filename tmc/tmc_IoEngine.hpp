@@ -0,0 +1,280 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_IOENGINE_HPP__
+#define __TMC_IOENGINE_HPP__
+
+#include "tmc_Reactor.hpp"
+#include "tmc_Uring.hpp"
+
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <chrono>
+
+namespace TMC{
+
+#ifdef __linux__
+
+enum class IoBackend: int{
+    EPOLL = 0,
+    IO_URING = 1,
+};
+
+// completion style async send / recv / accept
+// runs on io_uring when the kernel allows it, else on the epoll Reactor
+// the backend is picked at runtime by create
+// do not move an engine while ops are pending
+class IoEngine{
+public:
+    typedef std::function<void(Result<int>&)> WriteCallback;
+    typedef std::function<void(Result<ByteBuf>&)> ReadCallback;
+    typedef std::function<void(Result<Socket>&)> AcceptCallback;
+private:
+    // ops waiting for readiness, epoll backend only
+    struct _ReadOp{
+        bool is_accept;
+        bool multishot;
+        int size;
+        ReadCallback read_cb;
+        AcceptCallback accept_cb;
+    };
+    struct _WriteOp{
+        ByteBuf buf;
+        size_t offset;
+        WriteCallback cb;
+    };
+    struct _Pending{
+        Socket sock;
+        std::deque<_ReadOp> reads = {};
+        std::deque<_WriteOp> writes = {};
+        uint32_t events = 0;
+    };
+
+    IoBackend backend_ = IoBackend::EPOLL;
+    std::unique_ptr<Reactor> reactor_;
+#ifdef TMC_HAS_URING
+    std::unique_ptr<Uring> uring_;
+#endif
+    std::unordered_map<SOCKET,_Pending> pending_;
+
+    IoEngine()noexcept {}//hide
+
+    // register the fd for the events its queued ops need
+    Result<void> __update_interest(SOCKET _fd){
+        auto it = pending_.find(_fd);
+        if(it == pending_.end()){
+            return true;
+        }
+        _Pending& p = it->second;
+        uint32_t events = 0;
+        if(!p.reads.empty()) events |= Reactor::EV_READ;
+        if(!p.writes.empty()) events |= Reactor::EV_WRITE;
+        if(events == p.events){
+            return true;
+        }
+        Result<void> res(true);
+        if(!events){
+            res = reactor_->remove(p.sock);
+            pending_.erase(it);
+            return res;
+        }else if(!p.events){
+            res = reactor_->add(p.sock,events,[this,_fd](uint32_t ev){__on_ready(_fd,ev);});
+        }else{
+            res = reactor_->modify(p.sock,events);
+        }
+        if(res.check()){
+            p.events = events;
+        }
+        return res;
+    }
+
+    void __on_ready(SOCKET _fd,uint32_t _events){
+        auto it = pending_.find(_fd);
+        if(it == pending_.end()){
+            return;
+        }
+        if((_events & (Reactor::EV_READ|Reactor::EV_ERROR|Reactor::EV_HUP)) && !it->second.reads.empty()){
+            _Pending& p = it->second;
+            _ReadOp op = p.reads.front();
+            // the listener is non-blocking and recv uses MSG_DONTWAIT,
+            // so a stale readiness leaves the op queued instead of blocking the loop
+            if(op.is_accept){
+                Result<Socket> res = p.sock.accept();
+                if(res.check() || !Socket::would_block(res.error_code())){
+                    if(!op.multishot) p.reads.pop_front();
+                    op.accept_cb(res);
+                }
+            }else{
+                ByteBuf buf;
+                buf.reserve(op.size);
+                int ret = (int)::recv(_fd,(char*)buf.spare(),op.size,MSG_DONTWAIT);
+                int ec = ret == SOCKET_ERROR?sys_errno():0;
+                if(!ec || !Socket::would_block(ec)){
+                    if(!ec) buf.commit(ret);
+                    if(!op.multishot) p.reads.pop_front();
+                    Result<ByteBuf> res(!ec,std::move(buf),TMC_R_CALL_POS(ec));
+                    op.read_cb(res);
+                }
+            }
+            it = pending_.find(_fd);
+        }
+        if(it != pending_.end() && (_events & (Reactor::EV_WRITE|Reactor::EV_ERROR|Reactor::EV_HUP)) && !it->second.writes.empty()){
+            _Pending& p = it->second;
+            _WriteOp& op = p.writes.front();
+            int ret = ::send(_fd,(const char*)op.buf.view()+op.offset,(int)(op.buf.size()-op.offset),MSG_NOSIGNAL|MSG_DONTWAIT);
+            if(ret == SOCKET_ERROR && (sys_errno() == EAGAIN || sys_errno() == EWOULDBLOCK)){
+                return;
+            }
+            if(ret != SOCKET_ERROR){
+                op.offset += ret;
+                if(op.offset<op.buf.size()){
+                    return; // wait for the next writable event
+                }
+            }
+            int ec = ret == SOCKET_ERROR?sys_errno():0;
+            _WriteOp done = std::move(op);
+            p.writes.pop_front();
+            Result<int> res(ret != SOCKET_ERROR,(int)done.offset,TMC_R_CALL_POS(ec));
+            done.cb(res);
+        }
+        __update_interest(_fd).ignore();
+    }
+
+    _Pending& __pending(Socket const& _sock){
+        auto it = pending_.find(_sock.native_handle());
+        if(it == pending_.end()){
+            it = pending_.emplace(_sock.native_handle(),_Pending{_sock}).first;
+        }
+        return it->second;
+    }
+
+public:
+    IoEngine(IoEngine const&) = delete;
+    IoEngine& operator=(IoEngine const&) = delete;
+    IoEngine(IoEngine &&) = default;
+    IoEngine& operator=(IoEngine &&) = default;
+
+    // create an engine
+    // param _want IO_URING falls back to EPOLL if io_uring cannot be used
+    // param _entries ring size for io_uring, max events per loop for epoll
+    static Result<IoEngine> create(IoBackend _want = IoBackend::IO_URING,unsigned _entries = 256){
+        IoEngine res;
+#ifdef TMC_HAS_URING
+        if(_want == IoBackend::IO_URING && Uring::supported()){
+            auto uring_res = Uring::create(_entries);
+            if(uring_res.check()){
+                res.uring_.reset(new Uring(std::move(uring_res.ignore())));
+                res.backend_ = IoBackend::IO_URING;
+                return Result<IoEngine>(true,std::move(res));
+            }
+        }
+#endif
+        auto reactor_res = Reactor::create((int)_entries);
+        if(!reactor_res.check()){
+            return Result<IoEngine>(false,std::move(res),TMC_R_CALL_POS(sys_errno()));
+        }
+        res.reactor_.reset(new Reactor(std::move(reactor_res.ignore())));
+        res.backend_ = IoBackend::EPOLL;
+        return Result<IoEngine>(true,std::move(res));
+    }
+
+    IoBackend backend()const noexcept{
+        return backend_;
+    }
+
+    // the reactor, only for the EPOLL backend
+    Reactor* reactor()noexcept{
+        return reactor_.get();
+    }
+
+#ifdef TMC_HAS_URING
+    // the ring, only for the IO_URING backend
+    // use it for multishot recv and registered buffers
+    Uring* uring()noexcept{
+        return uring_.get();
+    }
+#endif
+
+    // send the whole buffer, cb gets the size written
+    Result<void> send(Socket const& _sock,ByteBuf&& _buf,WriteCallback const& _cb){
+#ifdef TMC_HAS_URING
+        if(uring_){
+            return uring_->send(_sock,std::move(_buf),_cb).map([](uint64_t){});
+        }
+#endif
+        __pending(_sock).writes.push_back(_WriteOp{std::move(_buf),0,_cb});
+        return __update_interest(_sock.native_handle());
+    }
+
+    // recv at most _size bytes
+    Result<void> recv(Socket const& _sock,int _size,ReadCallback const& _cb){
+#ifdef TMC_HAS_URING
+        if(uring_){
+            return uring_->recv(_sock,_size,_cb).map([](uint64_t){});
+        }
+#endif
+        __pending(_sock).reads.push_back(_ReadOp{false,false,_size,_cb,nullptr});
+        return __update_interest(_sock.native_handle());
+    }
+
+    // accept a connection
+    // param _multishot keep accepting, one callback per connection
+    // on the EPOLL backend _sock is switched to non-blocking, so another thread
+    // taking the connection first cannot block the loop in accept
+    Result<void> accept(Socket& _sock,AcceptCallback const& _cb,bool _multishot = false){
+#ifdef TMC_HAS_URING
+        if(uring_){
+            return uring_->accept(_sock,_cb,_multishot).map([](uint64_t){});
+        }
+#endif
+        auto nb_res = _sock.set_nonblocking(true);
+        if(!nb_res.check()){
+            return nb_res;
+        }
+        __pending(_sock).reads.push_back(_ReadOp{true,_multishot,0,nullptr,_cb});
+        return __update_interest(_sock.native_handle());
+    }
+
+    // submit queued ops, wait for completions and dispatch them
+    // param _timeout < 0 wait forever, 0 return immediately
+    Result<void> poll_once(std::chrono::milliseconds const& _timeout){
+#ifdef TMC_HAS_URING
+        if(uring_){
+            return uring_->poll_once(_timeout);
+        }
+#endif
+        return reactor_->poll_once(_timeout).map([](int){});
+    }
+};
+
+#endif
+
+}
+
+
+#endif
@@ -0,0 +1,465 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_LOGGER_HPP__
+#define __TMC_LOGGER_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <type_traits>
+
+// bytes of captured arguments per record, the rest is cut
+#define TMC_LOG_ARG_BYTES 192
+
+namespace TMC{
+
+template<typename T, typename = void>
+constexpr bool _L_is_outputable = false;
+template<typename T>
+constexpr bool _L_is_outputable<T,std::void_t<decltype(std::declval<std::ostream&>() << std::declval<T&>())>> = true;
+
+// arguments of one report kept in binary form
+// numbers are stored as they are, text is copied,
+// they are turned into text on the log thread
+class _LogArgs{
+    enum Tag: uint8_t{
+        T_I64 = 0,
+        T_U64 = 1,
+        T_F64 = 2,
+        T_CHAR = 3,
+        T_BOOL = 4,
+        T_STR = 5,
+    };
+    uint8_t data_[TMC_LOG_ARG_BYTES];
+    uint16_t size_ = 0;
+    bool cut_ = false;
+
+    bool __put(void const* _src,size_t _size){
+        if(size_+_size>TMC_LOG_ARG_BYTES){
+            cut_ = true;
+            return false;
+        }
+        ::memcpy(data_+size_,_src,_size);
+        size_ += (uint16_t)_size;
+        return true;
+    }
+    template<typename T>
+    void __put_val(Tag _tag,T _val){
+        if(size_+1+sizeof(T)>TMC_LOG_ARG_BYTES){
+            cut_ = true;
+            return;
+        }
+        __put(&_tag,1);
+        __put(&_val,sizeof(T));
+    }
+    void __put_str(std::string_view _str){
+        size_t room = TMC_LOG_ARG_BYTES-size_;
+        if(room<4){
+            cut_ = true;
+            return;
+        }
+        uint16_t len = (uint16_t)(_str.size()<room-3?_str.size():room-3);
+        cut_ |= len<_str.size();
+        Tag tag = T_STR;
+        __put(&tag,1);
+        __put(&len,2);
+        __put(_str.data(),len);
+    }
+    template<typename T>
+    void __add(T const& _arg){
+        typedef std::decay_t<T> D;
+        if constexpr(std::is_same_v<D,bool>){
+            __put_val(T_BOOL,(uint8_t)_arg);
+        }else if constexpr(std::is_same_v<D,char>){
+            __put_val(T_CHAR,_arg);
+        }else if constexpr(std::is_integral_v<D> && std::is_signed_v<D>){
+            __put_val(T_I64,(int64_t)_arg);
+        }else if constexpr(std::is_integral_v<D>){
+            __put_val(T_U64,(uint64_t)_arg);
+        }else if constexpr(std::is_floating_point_v<D>){
+            __put_val(T_F64,(double)_arg);
+        }else if constexpr(std::is_convertible_v<T const&,std::string_view>){
+            __put_str(std::string_view(_arg));
+        }else if constexpr(_L_is_outputable<T>){
+            std::ostringstream ss;  // other types are formatted right away
+            ss << _arg;
+            __put_str(ss.str());
+        }else{
+            __put_str("[Type not outputable]");
+        }
+    }
+
+public:
+    template<typename ..._Args>
+    void capture(_Args const& ...args){
+        size_ = 0;
+        cut_ = false;
+        (__add(args),...);
+    }
+
+    void format(std::string& _out)const{
+        char num[32];
+        size_t pos = 0;
+        while(pos<size_){
+            Tag tag = (Tag)data_[pos++];
+            switch(tag){
+            case T_I64:{
+                int64_t v;
+                ::memcpy(&v,data_+pos,8);
+                pos += 8;
+                _out.append(num,::snprintf(num,sizeof(num),"%lld",(long long)v));
+                break;
+            }
+            case T_U64:{
+                uint64_t v;
+                ::memcpy(&v,data_+pos,8);
+                pos += 8;
+                _out.append(num,::snprintf(num,sizeof(num),"%llu",(unsigned long long)v));
+                break;
+            }
+            case T_F64:{
+                double v;
+                ::memcpy(&v,data_+pos,8);
+                pos += 8;
+                _out.append(num,::snprintf(num,sizeof(num),"%g",v));
+                break;
+            }
+            case T_CHAR:
+                _out.push_back((char)data_[pos++]);
+                break;
+            case T_BOOL:
+                _out.push_back(data_[pos++]?'1':'0');
+                break;
+            case T_STR:{
+                uint16_t len;
+                ::memcpy(&len,data_+pos,2);
+                pos += 2;
+                _out.append((const char*)data_+pos,len);
+                pos += len;
+                break;
+            }
+            }
+        }
+        if(cut_){
+            _out += "...";
+        }
+    }
+};
+
+// one error report
+struct _LogRecord{
+    time_t time;
+    const char* func;
+    const char* file;
+    int line;
+    int ec;
+    _LogArgs args;
+};
+
+// single producer single consumer ring, one per reporting thread
+struct _LogRing{
+    std::vector<_LogRecord> slots;
+    std::atomic<size_t> head{0};    // next to read, moved by the log thread
+    std::atomic<size_t> tail{0};    // next to write, moved by the owner thread
+    std::atomic<bool> closed{false};// owner thread exited
+
+    explicit _LogRing(size_t _size):slots(_size){}
+};
+
+// asynchronous error log
+// once started, Result error reports are captured into a ring of the
+// calling thread and formatted / written by a background thread
+// a full ring drops the report instead of blocking
+// each sink is rate limited, the excess is counted and reported once a second
+class Logger{
+public:
+    typedef std::function<void(std::string_view)> Sink;
+private:
+    struct _Sink{
+        Sink fn;
+        size_t per_sec;
+        time_t window = 0;
+        size_t count = 0;
+        size_t suppressed = 0;
+    };
+    // the ring of this thread, closed when the thread exits
+    struct _Local{
+        std::shared_ptr<_LogRing> ring;
+        ~_Local(){
+            if(ring) ring->closed.store(true,std::memory_order_release);
+        }
+    };
+
+    std::mutex state_mtx_;          // serializes start and stop
+    std::atomic<bool> running_{false};
+    std::atomic<bool> sleeping_{false};
+    std::atomic<size_t> dropped_{0};
+    size_t ring_size_ = 256;
+    std::mutex rings_mtx_;
+    std::vector<std::shared_ptr<_LogRing>> rings_;
+    std::mutex drain_mtx_;          // held while records are written out
+    std::vector<_Sink> sinks_;
+    std::mutex wake_mtx_;
+    std::condition_variable wake_cv_;
+    std::thread thread_;
+    std::string line_;
+
+    Logger()noexcept {}//hide
+
+    _LogRing* __ring(){
+        thread_local _Local local;
+        if(!local.ring){
+            std::lock_guard<std::mutex> lk(rings_mtx_);
+            local.ring = std::make_shared<_LogRing>(ring_size_);
+            rings_.push_back(local.ring);
+        }
+        return local.ring.get();
+    }
+
+    static void __datetime(std::string& _out,time_t _when){
+        char buf[32];
+        tm ltm;
+#ifdef _WIN32
+        ::localtime_s(&ltm,&_when);
+#else
+        ::localtime_r(&_when,&ltm);
+#endif
+        _out.append(buf,::strftime(buf,sizeof(buf),"%Y-%m-%d %H:%M:%S",&ltm));
+    }
+
+    // same layout as the synchronous report of Result
+    void __format(_LogRecord const& _rec){
+        char num[16];
+        line_ = "RESULT ERROR with error code: ";
+        line_.append(num,::snprintf(num,sizeof(num),"%d",_rec.ec));
+        line_ += "\n\tMessage: ";
+        _rec.args.format(line_);
+        line_ += "\n\tTime: ";
+        __datetime(line_,_rec.time);
+        line_ += "\n\tLast call position: ";
+        line_ += _rec.file;
+        line_ += ':';
+        line_.append(num,::snprintf(num,sizeof(num),"%d",_rec.line));
+        line_ += "\n\tIn function: ";
+        line_ += _rec.func;
+        line_ += '\n';
+    }
+
+    // start a new second, telling how many reports the last one dropped
+    void __roll(_Sink& _sink,time_t _now){
+        if(_sink.window != _now){
+            if(_sink.suppressed){
+                std::string note = "LOGGER suppressed "+std::to_string(_sink.suppressed)+" error reports\n";
+                _sink.fn(note);
+            }
+            _sink.window = _now;
+            _sink.count = 0;
+            _sink.suppressed = 0;
+        }
+    }
+
+    void __emit(_Sink& _sink,std::string_view _text,time_t _now){
+        __roll(_sink,_now);
+        if(_sink.per_sec && _sink.count>=_sink.per_sec){
+            _sink.suppressed++;
+            return;
+        }
+        _sink.count++;
+        _sink.fn(_text);
+    }
+
+    // write out every queued record, return how many
+    size_t __drain(){
+        std::lock_guard<std::mutex> dlk(drain_mtx_);
+        std::vector<std::shared_ptr<_LogRing>> rings;
+        {
+            std::lock_guard<std::mutex> lk(rings_mtx_);
+            rings = rings_;
+        }
+        if(sinks_.empty()){
+            sinks_.push_back(_Sink{[](std::string_view _text){
+                ::fwrite(_text.data(),1,_text.size(),stderr);
+            },100});
+        }
+        size_t done = 0;
+        time_t now = ::time(0);
+        for(auto const& ring:rings){
+            size_t head = ring->head.load(std::memory_order_relaxed);
+            size_t tail = ring->tail.load(std::memory_order_acquire);
+            for(;head != tail;++head){
+                __format(ring->slots[head%ring->slots.size()]);
+                for(auto& sink:sinks_){
+                    __emit(sink,line_,now);
+                }
+                ++done;
+            }
+            ring->head.store(head,std::memory_order_release);
+        }
+        for(auto& sink:sinks_){
+            __roll(sink,now);
+        }
+        ::fflush(stderr);
+        // forget rings of exited threads once they are empty
+        std::lock_guard<std::mutex> lk(rings_mtx_);
+        for(size_t i = 0;i<rings_.size();){
+            auto& r = rings_[i];
+            if(r->closed.load(std::memory_order_acquire) && r->head.load() == r->tail.load()){
+                rings_[i] = rings_.back();
+                rings_.pop_back();
+            }else{
+                ++i;
+            }
+        }
+        return done;
+    }
+
+    void __loop(){
+        while(running_.load(std::memory_order_acquire)){
+            if(__drain()){
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(wake_mtx_);
+            sleeping_.store(true);
+            wake_cv_.wait_for(lk,std::chrono::milliseconds(50));
+            sleeping_.store(false);
+        }
+        __drain();
+    }
+
+public:
+    Logger(Logger const&) = delete;
+    Logger& operator=(Logger const&) = delete;
+    ~Logger(){
+        stop();
+    }
+
+    static Logger& instance(){
+        static Logger logger;
+        return logger;
+    }
+
+    // start the log thread
+    // param _ring_size records per reporting thread, used by rings created after this
+    void start(size_t _ring_size = 256){
+        std::lock_guard<std::mutex> slk(state_mtx_);
+        if(running()){
+            return;
+        }
+        {
+            // rings are created under this lock, set the size before reports can see running_
+            std::lock_guard<std::mutex> lk(rings_mtx_);
+            ring_size_ = _ring_size?_ring_size:1;
+        }
+        running_.store(true);
+        thread_ = std::thread([this]{__loop();});
+    }
+
+    // write out what is queued and stop the log thread
+    // reports go straight to stderr again
+    void stop(){
+        std::lock_guard<std::mutex> slk(state_mtx_);
+        if(!running_.exchange(false)){
+            return;
+        }
+        wake_cv_.notify_one();
+        thread_.join();
+    }
+
+    bool running()const noexcept{
+        return running_.load(std::memory_order_relaxed);
+    }
+
+    // add an output, e.g. a file
+    // param _per_sec max reports per second into this sink, 0 no limit
+    // if none is added before the first report is written,
+    // reports go to stderr at most 100 per second
+    void add_sink(Sink const& _fn,size_t _per_sec = 0){
+        std::lock_guard<std::mutex> lk(drain_mtx_);
+        sinks_.push_back(_Sink{_fn,_per_sec});
+    }
+
+    // wait until everything reported so far is written out
+    void flush(){
+        while(__drain());
+    }
+
+    // reports lost because a ring was full or memory ran out
+    size_t dropped()const noexcept{
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    // queue one report, never blocks, a full ring drops it
+    // a report that cannot be queued (out of memory) counts as dropped too
+    // return false if the logger is stopped, the caller reports it itself
+    template<typename ..._Args>
+    bool report(time_t _time,const char* _func,const char* _file,int _line,int _ec,_Args const& ...args) noexcept{
+        if(!running()){
+            return false;
+        }
+        try{
+            _LogRing* ring = __ring();
+            size_t tail = ring->tail.load(std::memory_order_relaxed);
+            if(tail-ring->head.load(std::memory_order_acquire) >= ring->slots.size()){
+                dropped_.fetch_add(1,std::memory_order_relaxed);
+                return true;
+            }
+            _LogRecord& rec = ring->slots[tail%ring->slots.size()];
+            rec.time = _time;
+            rec.func = _func;
+            rec.file = _file;
+            rec.line = _line;
+            rec.ec = _ec;
+            rec.args.capture(args...);
+            // seq_cst with the load below, so stop either sees the record or we see stop
+            ring->tail.store(tail+1);
+            if(!running_.load()){
+                __drain();  // stop may have done its last drain already
+            }else if(sleeping_.load(std::memory_order_relaxed)){
+                wake_cv_.notify_one();
+            }
+        }catch(...){
+            dropped_.fetch_add(1,std::memory_order_relaxed);
+        }
+        return true;
+    }
+};
+
+}
+
+
+#endif
@@ -0,0 +1,467 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_LOOPBACK_HPP__
+#define __TMC_LOOPBACK_HPP__
+
+#include "tmc_Socket.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+
+namespace TMC{
+
+// network conditions injected by a MemPipe, per direction
+// all randomness comes from seed, so a run can be replayed
+// loss and reorder work on whole writes, like datagrams on a real link
+struct Impairment{
+    std::chrono::microseconds latency{0};   // one way delay
+    std::chrono::microseconds jitter{0};    // delay varies by up to +-jitter
+    uint64_t bandwidth = 0;                 // bytes per second, 0 no limit
+    double loss = 0;                        // chance a write is dropped
+    double reorder = 0;                     // chance a write overtakes the one before it
+    uint64_t seed = 1;
+};
+
+// one end of an in-process byte pipe, built by MemPipe::pair
+// each direction is a fixed size ring buffer, no kernel, no fd
+// the read / write / wait calls mirror Socket, so code templated on
+// the transport runs on both
+// copies share the end, the end closes when the last copy is gone
+class MemPipe{
+    typedef std::chrono::steady_clock Clock;
+
+#ifdef _WIN32
+    static constexpr int E_AGAIN = WSAEWOULDBLOCK;
+    static constexpr int E_PIPE = WSAESHUTDOWN;
+    static constexpr int E_TIMEDOUT = WSAETIMEDOUT;
+    static constexpr int E_BADF = WSAENOTSOCK;
+#elif defined(__linux__)
+    static constexpr int E_AGAIN = EAGAIN;
+    static constexpr int E_PIPE = EPIPE;
+    static constexpr int E_TIMEDOUT = ETIMEDOUT;
+    static constexpr int E_BADF = EBADF;
+#endif
+
+    // one write, readable from _at on
+    struct _Segment{
+        size_t size;
+        size_t orig_size;
+        Clock::time_point at;
+    };
+    // one direction
+    struct _Channel{
+        std::mutex mtx;
+        std::condition_variable cv;     // readers and writers wait on it
+        std::vector<Byte> ring;
+        size_t head = 0;
+        size_t used = 0;
+        std::deque<_Segment> segs;
+        bool write_closed = false;      // reader drains, then gets end of stream
+        bool read_closed = false;       // writer gets E_PIPE
+        Impairment imp;
+        std::mt19937_64 rng;
+        Clock::time_point link_free;    // when the bandwidth cap frees the link
+        Clock::time_point last_at;      // deliveries stay in order
+
+        void __copy_in(size_t _pos,Byte const* _data,size_t _size){
+            size_t cap = ring.size();
+            _pos %= cap;
+            size_t first = cap-_pos<_size?cap-_pos:_size;
+            ::memcpy(ring.data()+_pos,_data,first);
+            ::memcpy(ring.data(),_data+first,_size-first);
+        }
+        void __copy_out(size_t _pos,Byte* _data,size_t _size)const{
+            size_t cap = ring.size();
+            _pos %= cap;
+            size_t first = cap-_pos<_size?cap-_pos:_size;
+            ::memcpy(_data,ring.data()+_pos,first);
+            ::memcpy(_data+first,ring.data(),_size-first);
+        }
+        // bytes that have arrived at the reader
+        size_t __arrived(Clock::time_point _now)const{
+            size_t res = 0;
+            for(auto const& seg:segs){
+                if(seg.at>_now) break;
+                res += seg.size;
+            }
+            return res;
+        }
+        bool __chance(double _p){
+            return _p>0 && std::uniform_real_distribution<double>(0,1)(rng)<_p;
+        }
+        // queue _size bytes, which must fit
+        void __push(Byte const* _data,size_t _size){
+            Clock::time_point now = Clock::now();
+            if(__chance(imp.loss)){
+                return;
+            }
+            Clock::time_point at = now;
+            if(imp.bandwidth){
+                if(link_free<now) link_free = now;
+                link_free += std::chrono::nanoseconds(_size*1000000000ull/imp.bandwidth);
+                at = link_free;
+            }
+            at += imp.latency;
+            if(imp.jitter.count()){
+                int64_t j = imp.jitter.count();
+                at += std::chrono::microseconds(std::uniform_int_distribution<int64_t>(-j,j)(rng));
+            }
+            if(at<last_at) at = last_at;
+            // overtake the last write if nothing of it has been read
+            _Segment* prev = segs.empty()?nullptr:&segs.back();
+            if(prev && prev->size == prev->orig_size && __chance(imp.reorder)){
+                size_t prev_pos = head+used-prev->size;
+                std::vector<Byte> tmp(prev->size);
+                __copy_out(prev_pos,tmp.data(),tmp.size());
+                __copy_in(prev_pos,_data,_size);
+                __copy_in(prev_pos+_size,tmp.data(),tmp.size());
+                _Segment moved = *prev;
+                *prev = _Segment{_size,_size,at<moved.at?at:moved.at};
+                segs.push_back(moved);
+            }else{
+                __copy_in(head+used,_data,_size);
+                segs.push_back(_Segment{_size,_size,at});
+                last_at = at;
+            }
+            used += _size;
+        }
+        // take up to _size arrived bytes
+        size_t __pop(Byte* _data,size_t _size,Clock::time_point _now){
+            size_t res = 0;
+            while(res<_size && !segs.empty() && segs.front().at<=_now){
+                _Segment& seg = segs.front();
+                size_t n = seg.size<_size-res?seg.size:_size-res;
+                __copy_out(head,_data+res,n);
+                head = (head+n)%ring.size();
+                used -= n;
+                seg.size -= n;
+                res += n;
+                if(!seg.size) segs.pop_front();
+            }
+            return res;
+        }
+    };
+    struct _Shared{
+        _Channel ch[2];     // ch[i] carries what end i writes
+    };
+    // closes its end when the last copy of it is gone
+    struct _End{
+        std::shared_ptr<_Shared> shared;
+        int side;
+        _End(std::shared_ptr<_Shared> const& _shared,int _side)noexcept:shared(_shared),side(_side){}
+        _End(_End const&) = delete;
+        ~_End(){
+            for(int i = 0;i<2;++i){
+                _Channel& c = shared->ch[i];
+                std::lock_guard<std::mutex> lk(c.mtx);
+                (i == side?c.write_closed:c.read_closed) = true;
+                c.cv.notify_all();
+            }
+        }
+    };
+
+    std::shared_ptr<_End> end_;
+    bool nonblocking_ = false;
+
+    MemPipe()noexcept {}//hide
+    template<typename ..._Types> friend class Result;
+
+    _Channel& __tx()const noexcept{
+        return end_->shared->ch[end_->side];
+    }
+    _Channel& __rx()const noexcept{
+        return end_->shared->ch[1-end_->side];
+    }
+    static Clock::time_point __deadline(std::chrono::milliseconds const& _timeout){
+        return _timeout == std::chrono::milliseconds(0)?Clock::time_point::max():Clock::now()+_timeout;
+    }
+
+    // wait until data arrived or the stream ended
+    // return false on deadline
+    bool __wait_readable(std::unique_lock<std::mutex>& _lk,_Channel& _c,Clock::time_point _deadline){
+        while(true){
+            Clock::time_point now = Clock::now();
+            if(_c.__arrived(now) || (_c.segs.empty() && _c.write_closed) || _c.read_closed){
+                return true;
+            }
+            if(now>=_deadline){
+                return false;
+            }
+            Clock::time_point until = _deadline;
+            if(!_c.segs.empty() && _c.segs.front().at<until){
+                until = _c.segs.front().at;
+            }
+            if(until == Clock::time_point::max()){
+                _c.cv.wait(_lk);
+            }else{
+                _c.cv.wait_until(_lk,until);
+            }
+        }
+    }
+    // wait until there is room or the peer is gone
+    bool __wait_writeable(std::unique_lock<std::mutex>& _lk,_Channel& _c,Clock::time_point _deadline){
+        auto ready = [&_c]{return _c.used<_c.ring.size() || _c.read_closed || _c.write_closed;};
+        if(_deadline == Clock::time_point::max()){
+            _c.cv.wait(_lk,ready);
+            return true;
+        }
+        return _c.cv.wait_until(_lk,_deadline,ready);
+    }
+
+    // write what fits, at least one byte unless non-blocking
+    Result<int> __write(Byte const* _data,size_t _size,Clock::time_point _deadline){
+        if(!end_){
+            return Result<int>(false,0,TMC_R_CALL_POS(E_BADF));
+        }
+        _Channel& c = __tx();
+        std::unique_lock<std::mutex> lk(c.mtx);
+        if(!_size){
+            return Result<int>(true,0);
+        }
+        if(!nonblocking_ && !__wait_writeable(lk,c,_deadline)){
+            return Result<int>(false,0,TMC_R_CALL_POS(E_TIMEDOUT));
+        }
+        if(c.read_closed || c.write_closed){
+            return Result<int>(false,0,TMC_R_CALL_POS(E_PIPE));
+        }
+        size_t room = c.ring.size()-c.used;
+        if(!room){
+            return Result<int>(false,0,TMC_R_CALL_POS(E_AGAIN));
+        }
+        int n = (int)(_size<room?_size:room);
+        c.__push(_data,n);
+        c.cv.notify_all();
+        return Result<int>(true,std::move(n));
+    }
+
+    // read what arrived, 0 at end of stream
+    Result<int> __read(Byte* _data,size_t _size,Clock::time_point _deadline){
+        if(!end_){
+            return Result<int>(false,0,TMC_R_CALL_POS(E_BADF));
+        }
+        _Channel& c = __rx();
+        std::unique_lock<std::mutex> lk(c.mtx);
+        if(!nonblocking_ && !__wait_readable(lk,c,_deadline)){
+            return Result<int>(false,0,TMC_R_CALL_POS(E_TIMEDOUT));
+        }
+        if(c.read_closed){
+            return Result<int>(true,0);     // shut down for reading
+        }
+        int n = (int)c.__pop(_data,_size,Clock::now());
+        if(!n && !(c.segs.empty() && c.write_closed)){
+            return Result<int>(false,0,TMC_R_CALL_POS(E_AGAIN));
+        }
+        if(n){
+            c.cv.notify_all();
+        }
+        return Result<int>(true,std::move(n));
+    }
+
+public:
+    // create two connected ends
+    // param _capacity ring size of each direction
+    // param _a_to_b impairment of what the first end writes
+    // param _b_to_a impairment of what the second end writes
+    static Result<MemPipe,MemPipe> pair(size_t _capacity,Impairment const& _a_to_b,Impairment const& _b_to_a){
+        if(!_capacity){
+            return Result<MemPipe,MemPipe>(false,std::make_tuple(MemPipe(),MemPipe()),TMC_R_CALL_POS(EINVAL));
+        }
+        auto shared = std::make_shared<_Shared>();
+        Impairment const* imps[2] = {&_a_to_b,&_b_to_a};
+        for(int i = 0;i<2;++i){
+            _Channel& c = shared->ch[i];
+            c.ring.resize(_capacity);
+            c.imp = *imps[i];
+            c.rng.seed(imps[i]->seed+i);
+        }
+        MemPipe a,b;
+        a.end_ = std::make_shared<_End>(shared,0);
+        b.end_ = std::make_shared<_End>(shared,1);
+        return Result<MemPipe,MemPipe>(true,std::make_tuple(std::move(a),std::move(b)));
+    }
+    static Result<MemPipe,MemPipe> pair(size_t _capacity = 65536,Impairment const& _impairment = Impairment()){
+        return pair(_capacity,_impairment,_impairment);
+    }
+
+    bool valid()const noexcept{
+        return end_ != nullptr;
+    }
+
+    // as Socket::set_nonblocking, only for this copy
+    Result<void> set_nonblocking(bool _nonblocking){
+        nonblocking_ = _nonblocking;
+        return true;
+    }
+    bool is_nonblocking()const noexcept{
+        return nonblocking_;
+    }
+
+    // SDT_SEND: the peer reads to the end of stream
+    // SDT_RECV: the peer's writes fail with EPIPE
+    Result<void> shutdown(Socket::ShutdownType _type = Socket::ShutdownType::SDT_BOTH){
+        if(!end_){
+            return {false,TMC_R_CALL_POS(E_BADF)};
+        }
+        if(_type != Socket::ShutdownType::SDT_RECV){
+            _Channel& c = __tx();
+            std::lock_guard<std::mutex> lk(c.mtx);
+            c.write_closed = true;
+            c.cv.notify_all();
+        }
+        if(_type != Socket::ShutdownType::SDT_SEND){
+            _Channel& c = __rx();
+            std::lock_guard<std::mutex> lk(c.mtx);
+            c.read_closed = true;
+            c.cv.notify_all();
+        }
+        return true;
+    }
+
+    // drop this copy, the end closes with the last copy
+    Result<void> close(){
+        if(!end_){
+            return {false,TMC_R_CALL_POS(E_BADF)};
+        }
+        end_.reset();
+        return true;
+    }
+
+    // as Socket::write, blocks only while the ring is full
+    Result<int> write(ByteBuf const& _buf){
+        return __write(_buf.view(),_buf.size(),Clock::time_point::max());
+    }
+    Result<void> write_all(ByteBuf const& _buf,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        Clock::time_point deadline = __deadline(_timeout);
+        size_t offset = 0;
+        while(offset<_buf.size()){
+            auto ret = __write(_buf.view()+offset,_buf.size()-offset,deadline);
+            if(!ret.check()){
+                if(!Socket::would_block(ret.error_code())){
+                    return {false,TMC_R_CALL_POS(ret.error_code())};
+                }
+                std::unique_lock<std::mutex> lk(__tx().mtx);
+                if(!__wait_writeable(lk,__tx(),deadline)){
+                    return {false,TMC_R_CALL_POS(E_TIMEDOUT)};
+                }
+                continue;
+            }
+            offset += ret.ignore();
+        }
+        return true;
+    }
+
+    // as Socket::readsome, an empty buf means end of stream
+    Result<ByteBuf> readsome(int _expect_size){
+        Result<ByteBuf> res(true);
+        ByteBuf& buf = res.ignore();
+        buf.reserve(_expect_size);
+        auto ret = __read(buf.spare(),_expect_size,Clock::time_point::max());
+        if(!ret.check()){
+            return {false,TMC_R_CALL_POS(ret.error_code())};
+        }
+        buf.commit(ret.ignore());
+        return res;
+    }
+    // as Socket::read_into
+    Result<int> read_into(std::span<Byte> _buf){
+        return __read(_buf.data(),_buf.size(),Clock::time_point::max());
+    }
+
+    // as Socket::readall, returns what arrived before the end of stream or _timeout
+    Result<ByteBuf> readall(int _expect_size,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        Clock::time_point deadline = __deadline(_timeout);
+        Result<ByteBuf> res(true);
+        ByteBuf& buf = res.ignore();
+        buf.reserve(_expect_size);
+        while((int)buf.size()<_expect_size){
+            if(!__await(true,deadline)){
+                break;
+            }
+            auto ret = __read(buf.spare(),_expect_size-buf.size(),deadline);
+            if(!ret.check()){
+                if(Socket::would_block(ret.error_code())){
+                    continue;
+                }
+                if(ret.error_code() == E_TIMEDOUT){
+                    break;
+                }
+                return {false,TMC_R_CALL_POS(ret.error_code())};
+            }
+            if(!ret.ignore()){
+                break;  // peer closed
+            }
+            buf.commit(ret.ignore());
+        }
+        return res;
+    }
+
+    // ready to read: data arrived or the stream ended
+    Result<bool> readable(){
+        return Result<bool>(end_ != nullptr,__await(true,Clock::now()),TMC_R_CALL_POS(end_?0:E_BADF));
+    }
+    // ready to write: there is room, or the write would fail right away
+    Result<bool> writeable(){
+        return Result<bool>(end_ != nullptr,__await(false,Clock::now()),TMC_R_CALL_POS(end_?0:E_BADF));
+    }
+    // as Socket::await_readable, timeout 0 waits forever
+    Result<bool> await_readable(std::chrono::milliseconds const& _timeout){
+        return Result<bool>(end_ != nullptr,__await(true,__deadline(_timeout)),TMC_R_CALL_POS(end_?0:E_BADF));
+    }
+    Result<bool> await_writeable(std::chrono::milliseconds const& _timeout){
+        return Result<bool>(end_ != nullptr,__await(false,__deadline(_timeout)),TMC_R_CALL_POS(end_?0:E_BADF));
+    }
+
+    // bytes written by the peer, arrived or still on the way
+    size_t in_flight()const{
+        if(!end_){
+            return 0;
+        }
+        _Channel& c = __rx();
+        std::lock_guard<std::mutex> lk(c.mtx);
+        return c.used;
+    }
+
+private:
+    bool __await(bool _read,Clock::time_point _deadline){
+        if(!end_){
+            return false;
+        }
+        _Channel& c = _read?__rx():__tx();
+        std::unique_lock<std::mutex> lk(c.mtx);
+        return _read?__wait_readable(lk,c,_deadline):__wait_writeable(lk,c,_deadline);
+    }
+};
+
+}
+
+
+#endif
@@ -0,0 +1,335 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_REACTOR_HPP__
+#define __TMC_REACTOR_HPP__
+
+#include "tmc_Socket.hpp"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <atomic>
+
+namespace TMC{
+
+#ifdef __linux__
+
+// epoll based event loop
+// register many sockets, then one epoll_wait per loop
+// dispatches every ready socket to its callback
+class Reactor{
+public:
+    enum class Trigger: int;
+    enum Event: uint32_t;
+    typedef std::function<void(uint32_t)> Callback;
+public:
+    enum class Trigger: int{
+        LEVEL = 0,
+        EDGE = 1,
+    };
+    // can be combined with |
+    enum Event: uint32_t{
+        EV_READ = EPOLLIN,
+        EV_WRITE = EPOLLOUT,
+        EV_ERROR = EPOLLERR,
+        EV_HUP = EPOLLHUP|EPOLLRDHUP,
+    };
+private:
+    struct _Handler{
+        Callback cb;
+        uint32_t events;
+        Trigger trigger;
+    };
+
+    bool valid_ = false;
+    int h_epoll_ = -1;
+    int h_wake_ = -1;       // eventfd, stop writes it to wake epoll_wait
+    std::atomic<bool> need_stop_{false};
+    std::vector<epoll_event> ready_;
+    // shared so that a callback can remove itself while it is running
+    std::unordered_map<SOCKET,std::shared_ptr<_Handler>> handlers_;
+
+    Reactor()noexcept {}//hide
+    Reactor(int _max_events):ready_(_max_events>0?_max_events:1){//hide
+        h_epoll_ = ::epoll_create1(EPOLL_CLOEXEC);
+        if(h_epoll_ == -1){
+            return;
+        }
+        h_wake_ = ::eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+        if(h_wake_ == -1){
+            return;
+        }
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = h_wake_;
+        if(::epoll_ctl(h_epoll_,EPOLL_CTL_ADD,h_wake_,&ev) == SOCKET_ERROR){
+            return;
+        }
+        valid_ = true;
+    }
+
+    // reset the eventfd after stop signalled it
+    void __drain_wake() noexcept{
+        eventfd_t count;
+        ::eventfd_read(h_wake_,&count);
+    }
+
+    static uint32_t __native_events(uint32_t _events,Trigger _trigger) noexcept{
+        if(_trigger == Trigger::EDGE){
+            _events |= EPOLLET;
+        }
+        return _events;
+    }
+
+    Result<void> __ctl(int _op,SOCKET _fd,uint32_t _events,Trigger _trigger){
+        epoll_event ev;
+        ev.events = __native_events(_events,_trigger);
+        ev.data.fd = _fd;
+        if(::epoll_ctl(h_epoll_,_op,_fd,&ev) == SOCKET_ERROR){
+            return {false,TMC_R_CALL_POS(sys_errno())};
+        }
+        return true;
+    }
+
+    // wait until _sock reports one of _events or timeout
+    // the loop keeps dispatching other sockets meanwhile
+    Result<bool> __await(Socket const& _sock,uint32_t _events,std::chrono::milliseconds const& _timeout){
+        bool fired = false;
+        auto add_res = add(_sock,_events,[&fired](uint32_t){fired = true;});
+        if(!add_res.check()){
+            return Result<bool>::err(false,TMC_R_CALL_POS(add_res.error_code()));
+        }
+        auto start = std::chrono::steady_clock::now();
+        while(!fired){
+            std::chrono::milliseconds left_time(-1);
+            if(_timeout != std::chrono::milliseconds(0)){
+                auto past_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                if(_timeout<=past_time){
+                    break;
+                }
+                left_time = _timeout-past_time;
+            }
+            auto poll_res = poll_once(left_time);
+            if(!poll_res.check()){
+                int ec = poll_res.error_code();     // remove may overwrite errno
+                remove(_sock).ignore();
+                return Result<bool>::err(false,TMC_R_CALL_POS(ec));
+            }
+        }
+        remove(_sock).ignore();
+        return Result<bool>::ok(std::move(fired));
+    }
+
+    void __close(){
+        if(h_epoll_ != -1){
+            ::close(h_epoll_);
+            h_epoll_ = -1;
+        }
+        if(h_wake_ != -1){
+            ::close(h_wake_);
+            h_wake_ = -1;
+        }
+        valid_ = false;
+    }
+
+public:
+    Reactor(Reactor const&) = delete;
+    Reactor& operator=(Reactor const&) = delete;
+    Reactor(Reactor && other) noexcept
+        :valid_(other.valid_)
+        ,h_epoll_(other.h_epoll_)
+        ,h_wake_(other.h_wake_)
+        ,need_stop_(other.need_stop_.load())
+        ,ready_(std::move(other.ready_))
+        ,handlers_(std::move(other.handlers_))
+    {
+        other.valid_ = false;
+        other.h_epoll_ = -1;
+        other.h_wake_ = -1;
+    }
+    Reactor& operator=(Reactor && other) noexcept{
+        if(this != &other){
+            __close();
+            valid_ = other.valid_;
+            h_epoll_ = other.h_epoll_;
+            h_wake_ = other.h_wake_;
+            need_stop_.store(other.need_stop_.load());
+            ready_ = std::move(other.ready_);
+            handlers_ = std::move(other.handlers_);
+            other.valid_ = false;
+            other.h_epoll_ = -1;
+            other.h_wake_ = -1;
+        }
+        return *this;
+    }
+    ~Reactor(){
+        __close();
+    }
+
+    // create a reactor
+    // param _max_events max events reaped by one epoll_wait
+    static Result<Reactor> create(int _max_events = 1024){
+        Reactor res(_max_events);
+        return Result<Reactor>(res.valid_,std::move(res),TMC_R_CALL_POS(res.valid_?0:sys_errno()));
+    }
+
+    bool valid()const noexcept{
+        return valid_;
+    }
+
+    // get the native epoll handle
+    int native_handle()const noexcept{
+        return h_epoll_;
+    }
+
+    // count of registered sockets
+    size_t size()const noexcept{
+        return handlers_.size();
+    }
+
+    // register a socket
+    // param _events Event combined with |
+    // param _cb called with the ready events
+    // param _trigger level or edge triggered
+    Result<void> add(Socket const& _sock,uint32_t _events,Callback const& _cb,Trigger _trigger = Trigger::LEVEL){
+        return add(_sock.native_handle(),_events,_cb,_trigger);
+    }
+    Result<void> add(SOCKET fd,uint32_t _events,Callback const& _cb,Trigger _trigger = Trigger::LEVEL){
+        auto res = __ctl(EPOLL_CTL_ADD,fd,_events,_trigger);
+        if(res.check()){
+            handlers_[fd] = std::make_shared<_Handler>(_Handler{_cb,_events,_trigger});
+        }
+        return res;
+    }
+
+    // change the events or trigger of a registered socket
+    Result<void> modify(Socket const& _sock,uint32_t _events,Trigger _trigger = Trigger::LEVEL){
+        return modify(_sock.native_handle(),_events,_trigger);
+    }
+    Result<void> modify(SOCKET fd,uint32_t _events,Trigger _trigger = Trigger::LEVEL){
+        auto it = handlers_.find(fd);
+        if(it == handlers_.end()){
+            return {false,TMC_R_CALL_POS(ENOENT)};
+        }
+        auto res = __ctl(EPOLL_CTL_MOD,fd,_events,_trigger);
+        if(res.check()){
+            it->second->events = _events;
+            it->second->trigger = _trigger;
+        }
+        return res;
+    }
+
+    // unregister a socket
+    // can be called inside a callback, also for the socket being dispatched
+    Result<void> remove(Socket const& _sock){
+        return remove(_sock.native_handle());
+    }
+    Result<void> remove(SOCKET fd){
+        handlers_.erase(fd);
+        return __ctl(EPOLL_CTL_DEL,fd,0,Trigger::LEVEL);
+    }
+
+    // one epoll_wait, then dispatch all ready sockets
+    // param _timeout < 0 wait forever, 0 return immediately
+    // return count of dispatched events
+    Result<int> poll_once(std::chrono::milliseconds const& _timeout){
+        int n = ::epoll_wait(h_epoll_,ready_.data(),(int)ready_.size(),(int)_timeout.count());
+        if(n == SOCKET_ERROR){
+            if(sys_errno() == EINTR){
+                return Result<int>::ok(0);
+            }
+            return Result<int>(false,0,TMC_R_CALL_POS(sys_errno()));
+        }
+        int dispatched = 0;
+        for(int i = 0;i<n;i++){
+            if(ready_[i].data.fd == h_wake_){
+                __drain_wake();
+                continue;
+            }
+            auto it = handlers_.find(ready_[i].data.fd);
+            if(it == handlers_.end()){
+                continue;   // removed by an earlier callback
+            }
+            std::shared_ptr<_Handler> handler = it->second;
+            handler->cb(ready_[i].events);
+            dispatched++;
+        }
+        if(n == (int)ready_.size()){
+            ready_.resize(ready_.size()*2);
+        }
+        return Result<int>::ok(std::move(dispatched));
+    }
+
+    // run the loop until stop is called
+    // a stop before run makes it return at once
+    Result<void> run(){
+        while(!need_stop_.load()){
+            auto res = poll_once(std::chrono::milliseconds(-1));
+            if(!res.check()){
+                return {false,TMC_R_CALL_POS(res.error_code())};
+            }
+        }
+        need_stop_.store(false);
+        return true;
+    }
+
+    // make run return after the current loop
+    // can be called from any thread, wakes a blocked epoll_wait
+    void stop()noexcept{
+        need_stop_.store(true);
+        ::eventfd_write(h_wake_,1);
+    }
+
+    // same as Socket::await_readable, but waits through this reactor
+    // _sock must not be registered
+    // if timeout is 0 wait forever
+    Result<bool> await_readable(Socket const& _sock,std::chrono::milliseconds const& _timeout){
+        return __await(_sock,EV_READ,_timeout);
+    }
+
+    // same as Socket::await_writeable, but waits through this reactor
+    // _sock must not be registered
+    // if timeout is 0 wait forever
+    Result<bool> await_writeable(Socket const& _sock,std::chrono::milliseconds const& _timeout){
+        return __await(_sock,EV_WRITE,_timeout);
+    }
+};
+
+#endif
+
+}
+
+
+#endif
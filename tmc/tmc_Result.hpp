@@ -33,8 +33,14 @@ SOFTWARE.
 #include <ctime>
 #include <functional>
 #include <sstream>
+#include <source_location>
+#include <type_traits>
 
-#define TMC_R_CALL_POS(ec) TMC::_R_CallInfo{TMC::_R_datetime(),__FUNCTION__,__FILE__,__LINE__,ec}
+#include "tmc_Logger.hpp"
+
+// the call position is a std::source_location, static data built by the compiler,
+// nothing is formatted until an error gets printed
+#define TMC_R_CALL_POS(ec) TMC::_R_call_pos(ec)
 
 namespace TMC{
 
@@ -49,13 +55,15 @@ typedef _1st type;
 };
 
 struct _R_CallInfo{
-    std::string time = "";
-    std::string func = "";
-    std::string file = "";
-    int line = 0;
+    std::source_location pos;
     int ec = 0;
 };
 
+// _pos defaults to the place TMC_R_CALL_POS is written
+inline _R_CallInfo _R_call_pos(int _ec,std::source_location _pos = std::source_location::current()) noexcept{
+    return _R_CallInfo{_pos,_ec};
+}
+
 // if (_Tp == void)
 //      type = bool
 // else 
@@ -114,10 +122,9 @@ struct SimplePrint<_First>{
     }
 };
 
-inline std::string _R_datetime(){
+inline std::string _R_datetime(time_t _when){
     std::stringstream ss;
-    time_t now = ::time(0);
-    tm* ltm = ::localtime(&now);
+    tm* ltm = ::localtime(&_when);
     ss << (ltm->tm_year+1900)<<'-';
     if(ltm->tm_mon+1<10){
         ss << '0'<<(ltm->tm_mon+1)<<'-';
@@ -149,6 +156,9 @@ inline std::string _R_datetime(){
     
     //<<(ltm->tm_mon+1)<<(ltm->tm_year+1900);
 };
+inline std::string _R_datetime(){
+    return _R_datetime(::time(0));
+}
 
 // the type must be copied to construct for Result
 template<typename T>
@@ -157,12 +167,25 @@ constexpr bool _R_must_copy = ((!std::is_move_assignable_v<std::decay_t<T>>)
                                 || 
                                 std::is_pointer_v<std::decay_t<T>>;
 
+template<typename ..._Types>
+class Result;
+
+template<typename T>
+constexpr bool _R_is_result = false;
+template<typename ..._Types>
+constexpr bool _R_is_result<Result<_Types...>> = true;
+
 // this class holds values of returns
 // if _Types are moveable and is not a pointer,
 // you must pass a rvalue into constrcutor
 // else you can pass lvalue into constructor
+// layout: the data, the error code with the ok bit and the call position
+// which is a pointer to static data, so Result<int> or Result<bool> is 16 bytes,
+// as trivially copyable as the data and returned in two registers
+// the time of an error is read when it gets reported
 template<typename ..._Types>
-class Result{
+class [[nodiscard]] Result{
+    template<typename ...> friend class Result;
 public:
     using DataType =  
     std::conditional_t<sizeof...(_Types) == 0,
@@ -181,46 +204,70 @@ public:
                 DataType &&>;           // for types moveable               // move constructor
     
 private:
-    bool result_ = false;
     DataType data_;
-    _R_CallInfo call_info_;
+    int ec_ : 31;
+    unsigned result_ : 1;
+    std::source_location pos_;
+
+    static constexpr bool has_value_ = sizeof...(_Types)>1 || (sizeof...(_Types) == 1 && !std::is_same_v<void,typename GetFirstParam<_Types...>::type>);
+    // what ignore() const refers to when there is no value
+    static constexpr bool _R_true = true;
+    static constexpr bool _R_false = false;
+
+    _R_CallInfo __call_info()const noexcept{
+        return _R_CallInfo{pos_,ec_};
+    }
 
     template<typename ..._Args>
-    void __print_err(_Args const& ...args){
+    void __print_err(_Args const& ...args)const{
+        time_t when = ::time(0);
+        if(Logger::instance().report(when,pos_.function_name(),pos_.file_name(),(int)pos_.line(),ec_,args...)){
+            return;
+        }
         SimplePrint(std::cerr,
-            "RESULT ERROR with error code: ",call_info_.ec,'\n',
+            "RESULT ERROR with error code: ",(int)ec_,'\n',
             "\tMessage: ",args...,'\n',
-            "\tTime: ",call_info_.time,'\n',
-            "\tLast call position: ",call_info_.file,':',call_info_.line,'\n',
-            "\tIn function: ",call_info_.func,'\n').flush();
+            "\tTime: ",_R_datetime(when),'\n',
+            "\tLast call position: ",pos_.file_name(),':',pos_.line(),'\n',
+            "\tIn function: ",pos_.function_name(),'\n').flush();
+    }
+
+    // the exception may end the program before the log thread runs
+    static void __flush_err(){
+        if(Logger::instance().running()){
+            Logger::instance().flush();
+        }
     }
 
 public:
-    ~Result()noexcept(std::is_nothrow_destructible_v<DataType>){}
     // DataType data_ will call its default constructor
     Result(bool res)
         noexcept(std::is_nothrow_default_constructible_v<DataType>) 
-        :result_(res)
-        ,data_()
-        ,call_info_(){}
+        :data_()
+        ,ec_(0)
+        ,result_(res)
+        ,pos_(){}
     // DataType data_ will call its default constructor
     Result(bool res,_R_CallInfo&& _call_info)
         noexcept(std::is_nothrow_default_constructible_v<DataType>) 
-        :result_(res)
-        ,data_()
-        ,call_info_(_call_info){}
+        :data_()
+        ,ec_(_call_info.ec)
+        ,result_(res)
+        ,pos_(_call_info.pos){}
     // DataType data_ will call its default move constructor
     Result(bool res,ConstructType data) 
         noexcept(std::is_nothrow_move_constructible_v<DataType>) 
-        :result_(res)
-        ,data_(data)
-        ,call_info_(){}
+        :data_(std::move(data))
+        ,ec_(0)
+        ,result_(res)
+        ,pos_(){}
     // DataType data_ will call its default move constructor
     Result(bool res,ConstructType data,_R_CallInfo&& _call_info) 
         noexcept(std::is_nothrow_move_constructible_v<DataType>) 
-        :result_(res)
-        ,data_(data)
-        ,call_info_(_call_info){}
+        :data_(std::move(data))
+        ,ec_(_call_info.ec)
+        ,result_(res)
+        ,pos_(_call_info.pos){}
 
 
     // DataType data_ will call its default constructor
@@ -245,7 +292,7 @@ public:
     static Result err(ConstructType data,_R_CallInfo && err_info)
         noexcept(std::is_nothrow_move_constructible_v<DataType>) 
     {
-        return Result<_Types...>(false,std::forward<DataType>(data)); 
+        return Result<_Types...>(false,std::forward<DataType>(data),std::forward<_R_CallInfo>(err_info)); 
     }
     
     
@@ -255,7 +302,8 @@ public:
     auto& except(_Args const& ...args){
         if(!result_){
             __print_err(args...);
-            throw call_info_.ec;
+            __flush_err();
+            throw (int)ec_;
         }
         return ignore();
     }
@@ -269,23 +317,15 @@ public:
     }
     // get the value, throw -1
     auto& unwrap(){
-        if(!result_)throw call_info_.ec;
+        if(!result_)throw (int)ec_;
         return ignore();
     }
     // get the value anyway
     auto& ignore() noexcept{
-        const size_t pack_size = sizeof...(_Types);
-        if constexpr (pack_size == 0){
-            return result_;
-        }
-        else if constexpr (pack_size ==1){
-            if constexpr(std::is_same<void,_Types...>::value){
-                return result_;
-            }else{
-                return data_;
-            }
-        }
-        else {
+        if constexpr (has_value_){
+            return data_;
+        }else{
+            data_ = result_;    // DataType is bool
             return data_;
         }
     }
@@ -305,30 +345,23 @@ public:
     const auto& except(_Args const& ...args) const{
         if(!result_){
             __print_err(args...);
-            throw call_info_.ec;
+            __flush_err();
+            throw (int)ec_;
         }
         return ignore();
     }
     // get the value, throw on error
     const auto& unwrap() const{
-        if(!result_)throw call_info_.ec;
+        if(!result_)throw (int)ec_;
         return ignore();
     }
     // get the value anyway
+    // for a Result without value this is the result itself
     const auto& ignore() const noexcept{
-        const size_t pack_size = sizeof...(_Types);
-        if constexpr (pack_size == 0){
-            return result_;
-        }
-        else if constexpr (pack_size ==1){
-            if constexpr(std::is_same<void,_Types...>::value){
-                return result_;
-            }else{
-                return data_;
-            }
-        }
-        else {
+        if constexpr (has_value_){
             return data_;
+        }else{
+            return result_?_R_true:_R_false;
         }
     }
     
@@ -354,16 +387,68 @@ public:
     }
 
     void set_ec(int ec) noexcept{
-        call_info_.ec = ec;
+        ec_ = ec;
+    }
+
+    // get the error code recorded at the call position
+    int error_code()const noexcept{
+        return ec_;
+    }
+
+    // where the Result was made, empty if it was not recorded
+    std::source_location const& call_pos()const noexcept{
+        return pos_;
     }
     
-    Result or_else(std::function<Result()> const&f){
-        if(!result_) return f();
-        return std::move(*this);
+    // if ok, return f() or f(value), which must return a Result
+    // else pass the error on as that Result
+    // the value is moved into f
+    template<typename _Fn>
+    auto and_then(_Fn && f){
+        if constexpr(has_value_ && std::is_invocable_v<_Fn,DataType&&>){
+            using _Ret = std::decay_t<std::invoke_result_t<_Fn,DataType&&>>;
+            static_assert(_R_is_result<_Ret>,"and_then must return a Result");
+            if(result_) return _Ret(f(std::move(data_)));
+            return _Ret(false,__call_info());
+        }else{
+            using _Ret = std::decay_t<std::invoke_result_t<_Fn>>;
+            static_assert(_R_is_result<_Ret>,"and_then must return a Result");
+            if(result_) return _Ret(f());
+            return _Ret(false,__call_info());
+        }
     }
 
-    Result and_then(std::function<Result()> const&f){
-        if(result_) return f();
+    // if ok, return Result<U>(true,f(value)), else pass the error on
+    // the value is moved into f
+    template<typename _Fn>
+    auto map(_Fn && f){
+        using _Inv = std::conditional_t<has_value_,std::invoke_result<_Fn,DataType&&>,std::invoke_result<_Fn>>;
+        using _U = std::decay_t<typename _Inv::type>;
+        using _Ret = std::conditional_t<std::is_void_v<_U>,Result<void>,Result<_U>>;
+        if(!result_){
+            return _Ret(false,__call_info());
+        }
+        if constexpr(std::is_void_v<_U>){
+            if constexpr(has_value_) f(std::move(data_)); else f();
+            return _Ret(true);
+        }else if constexpr(has_value_){
+            return _Ret(true,f(std::move(data_)));
+        }else{
+            return _Ret(true,f());
+        }
+    }
+
+    // if error, return f() or f(error_code) as this Result type
+    // else the Result itself, moved out
+    template<typename _Fn>
+    Result or_else(_Fn && f){
+        if(!result_){
+            if constexpr(std::is_invocable_v<_Fn,int>){
+                return f((int)ec_);
+            }else{
+                return f();
+            }
+        }
         return std::move(*this);
     }
 
@@ -371,12 +456,16 @@ public:
     auto then(_Fn && f) ->decltype(f()){
         return f();
     }
-
 };
 
 // template<>
 // Result<void>::Result(bool res,Result<void>::ConstructTypeLRef data)= delete;
 
+// keep the common results small enough to come back in registers
+static_assert(sizeof(Result<int>)<=16,"Result<int> must stay within 16 bytes");
+static_assert(sizeof(Result<bool>)<=16,"Result<bool> must stay within 16 bytes");
+static_assert(sizeof(Result<void>)<=16,"Result<void> must stay within 16 bytes");
+
 }
 
 
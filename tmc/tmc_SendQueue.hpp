@@ -0,0 +1,261 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_SENDQUEUE_HPP__
+#define __TMC_SENDQUEUE_HPP__
+
+#include "tmc_Socket.hpp"
+#include "tmc_BufferChain.hpp"
+#include "tmc_Reactor.hpp"
+
+#include <functional>
+
+namespace TMC{
+
+// outbound queue of one connection
+// push never blocks, what the socket does not take now is kept and
+// drained when it turns writable
+// producers get on_pause once the queue reaches the high watermark
+// and on_resume once it drained down to the low watermark
+// so a slow peer costs bounded memory and never stalls the others
+class SendQueue{
+public:
+    typedef std::function<void()> Callback;
+private:
+    Socket sock_;
+    BufferChain queue_;
+    size_t high_ = 0;
+    size_t low_ = 0;
+    size_t max_ = 0;
+    bool paused_ = false;
+    bool want_write_ = false;
+    Callback on_pause_;
+    Callback on_resume_;
+    std::function<void(bool)> on_want_write_;
+    std::function<void(int)> on_error_;
+#ifdef __linux__
+    Reactor* reactor_ = nullptr;
+    uint32_t read_events_ = 0;
+#endif
+
+    SendQueue(Socket const& _sock)noexcept:sock_(_sock){}//hide
+
+    void __want_write(bool _want){
+        if(_want == want_write_){
+            return;
+        }
+        want_write_ = _want;
+#ifdef __linux__
+        if(reactor_){
+            reactor_->modify(sock_,read_events_|(_want?(uint32_t)Reactor::EV_WRITE:0u)).ignore();
+        }
+#endif
+        if(on_want_write_){
+            on_want_write_(_want);
+        }
+    }
+
+    // take the state of _other, which must be detached
+    void __take(SendQueue& _other){
+        sock_ = _other.sock_;
+        queue_ = std::move(_other.queue_);
+        high_ = _other.high_;
+        low_ = _other.low_;
+        max_ = _other.max_;
+        paused_ = _other.paused_;
+        want_write_ = _other.want_write_;
+        on_pause_ = std::move(_other.on_pause_);
+        on_resume_ = std::move(_other.on_resume_);
+        on_want_write_ = std::move(_other.on_want_write_);
+        on_error_ = std::move(_other.on_error_);
+#ifdef __linux__
+        read_events_ = _other.read_events_;
+#endif
+    }
+
+    void __check_marks(){
+        size_t size = queue_.size();
+        if(!paused_ && size>=high_){
+            paused_ = true;
+            if(on_pause_) on_pause_();
+        }else if(paused_ && size<=low_){
+            paused_ = false;
+            if(on_resume_) on_resume_();
+        }
+    }
+
+public:
+    SendQueue(SendQueue const&) = delete;
+    SendQueue& operator=(SendQueue const&) = delete;
+    // the reactor callback points at the attached object,
+    // so moving detaches the source and the new queue has to be attached again
+    SendQueue(SendQueue && other) noexcept:sock_(other.sock_){
+        other.detach();
+        __take(other);
+    }
+    SendQueue& operator=(SendQueue && other) noexcept{
+        if(this != &other){
+            detach();
+            other.detach();
+            __take(other);
+        }
+        return *this;
+    }
+    ~SendQueue(){
+        detach();
+    }
+
+    // the socket is switched to non-blocking
+    // param _high pause producers once this many bytes are queued
+    // param _low resume them once the queue is down to this
+    // param _max push fails with ENOBUFS beyond this, 0 no limit
+    static Result<SendQueue> create(Socket const& _sock,size_t _high = 1024*1024,size_t _low = 256*1024,size_t _max = 0){
+        SendQueue res(_sock);
+        res.high_ = _high;
+        res.low_ = _low<_high?_low:_high;
+        res.max_ = _max;
+        auto nb_res = res.sock_.set_nonblocking(true);
+        return Result<SendQueue>(nb_res.check(),std::move(res),TMC_R_CALL_POS(nb_res.error_code()));
+    }
+
+    // queue _buf, sent right away as far as the socket takes it
+    Result<void> push(ByteBuf&& _buf){
+        if(max_ && queue_.size()+_buf.size()>max_){
+            return {false,TMC_R_CALL_POS(ENOBUFS)};
+        }
+        queue_.push_back(std::move(_buf));
+        if(want_write_){
+            __check_marks();    // already waiting for writability
+            return true;
+        }
+        return flush();
+    }
+    Result<void> push(ByteBuf const& _buf){
+        return push(ByteBuf(_buf));
+    }
+    // queue a shared payload, e.g. one message fanned out to many peers
+    // the bytes are not copied, the queue holds the view until they are sent
+    Result<void> push(ByteView const& _view){
+        if(max_ && queue_.size()+_view.size()>max_){
+            return {false,TMC_R_CALL_POS(ENOBUFS)};
+        }
+        queue_.push_back(_view);
+        if(want_write_){
+            __check_marks();
+            return true;
+        }
+        return flush();
+    }
+
+    // write as much of the queue as the socket takes without blocking
+    // call it when the socket turns writable, attach does that for you
+    Result<void> flush(){
+        while(queue_.size()){
+            auto ret = sock_.write(queue_);
+            if(!ret.check()){
+                if(Socket::would_block(ret.error_code())){
+                    break;
+                }
+                __want_write(false);
+                return {false,TMC_R_CALL_POS(ret.error_code())};
+            }
+            queue_.pop_front(ret.ignore());
+        }
+        __want_write(queue_.size()>0);
+        __check_marks();
+        return true;
+    }
+
+    // bytes queued
+    size_t size()const noexcept{
+        return queue_.size();
+    }
+    bool paused()const noexcept{
+        return paused_;
+    }
+    // true while data waits for the socket to turn writable
+    bool want_write()const noexcept{
+        return want_write_;
+    }
+    Socket const& socket()const noexcept{
+        return sock_;
+    }
+
+    void on_pause(Callback const& _cb){
+        on_pause_ = _cb;
+    }
+    void on_resume(Callback const& _cb){
+        on_resume_ = _cb;
+    }
+    // for a custom event loop: watch writability while called with true
+    void on_want_write(std::function<void(bool)> const& _cb){
+        on_want_write_ = _cb;
+    }
+    // a write failed while flushing from the reactor
+    void on_error(std::function<void(int)> const& _cb){
+        on_error_ = _cb;
+    }
+
+#ifdef __linux__
+    // register the socket in _reactor and drain whenever it turns writable
+    // _on_read gets the other events, since a socket has one handler per reactor
+    // moving the queue detaches it
+    Result<void> attach(Reactor& _reactor,Reactor::Callback const& _on_read = nullptr){
+        detach();
+        read_events_ = _on_read?(uint32_t)Reactor::EV_READ:0u;
+        uint32_t events = read_events_|(want_write_?(uint32_t)Reactor::EV_WRITE:0u);
+        auto res = _reactor.add(sock_,events,[this,_on_read](uint32_t ev){
+            if(_on_read && (ev & (Reactor::EV_READ|Reactor::EV_ERROR|Reactor::EV_HUP))){
+                _on_read(ev);
+            }
+            if(want_write_ && (ev & (Reactor::EV_WRITE|Reactor::EV_ERROR))){
+                auto flush_res = flush();
+                if(!flush_res.check() && on_error_){
+                    on_error_(flush_res.error_code());
+                }
+            }
+        });
+        if(res.check()){
+            reactor_ = &_reactor;
+        }
+        return res;
+    }
+
+    void detach(){
+        if(reactor_){
+            reactor_->remove(sock_).ignore();
+            reactor_ = nullptr;
+        }
+    }
+#else
+    void detach(){}
+#endif
+};
+
+}
+
+
+#endif
@@ -29,6 +29,7 @@ SOFTWARE.
 
 
 #include "tmc_ByteBuf.hpp"
+#include "tmc_BufferChain.hpp"
 #include "tmc_Result.hpp"
 
 #ifdef _WIN32
@@ -45,6 +46,17 @@ SOFTWARE.
 #define SOCKET int
 #define closesocket(_sock) close(_sock)
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <errno.h>
 #endif
 
@@ -52,6 +64,31 @@ SOFTWARE.
 #include <tuple>
 #include <chrono>
 #include <memory>
+#include <vector>
+#include <span>
+#include <deque>
+#include <functional>
+#include <coroutine>
+
+// max segments of a BufferChain passed to one sendmsg / recvmsg
+#ifndef TMC_IOV_BATCH
+#define TMC_IOV_BATCH 64
+#endif
+
+// max datagrams passed to one recvmmsg / sendmmsg
+#ifndef TMC_MMSG_BATCH
+#define TMC_MMSG_BATCH 64
+#endif
+
+// max fds passed by one Socket::send_fds / recv_fds
+#ifndef TMC_SCM_MAX_FDS
+#define TMC_SCM_MAX_FDS 64
+#endif
+
+// max datagrams the kernel builds from one UDP_SEGMENT send
+#ifndef TMC_GSO_MAX_SEGMENTS
+#define TMC_GSO_MAX_SEGMENTS 64
+#endif
 
 #define ROUTE_SOCK_OPT(_optname,_level,_type)\
 template<> struct GetSockOptDetails<_optname>{\
@@ -59,12 +96,20 @@ template<> struct GetSockOptDetails<_optname>{\
     static const int level = _level;\
     static const int optname = _optname;}
 
+// for options whose number is taken at another level, e.g. IP_TOS == TCP_NODELAY
+// use them as setopt<_optname,_level>
+#define ROUTE_SOCK_OPT_AT(_optname,_level,_type)\
+template<> struct GetSockOptDetails<_optname,_level>{\
+    typedef _type type;\
+    static const int level = _level;\
+    static const int optname = _optname;}
+
 namespace TMC{
 
 class IPAddr;
 class Socket;
 
-template<int _opt> struct GetSockOptDetails;
+template<int _opt,int _level = -1> struct GetSockOptDetails;
 
 inline int sys_errno();
 
@@ -87,11 +132,28 @@ public:
     enum class Type: int{
         V4 = 0,
         V6 = 1,
+        UNIX = 2,
     };
 private:
-    sockaddr_in addr_in_;
+    union{
+        sockaddr_in addr_in_;
+#ifdef __linux__
+        sockaddr_un addr_un_;
+#endif
+    };
     Type type_ = Type::V4;
+    int len_ = sizeof(sockaddr_in);
+
+    sockaddr const* __name()const noexcept{
+        return (sockaddr const*)&addr_in_;
+    }
+    int __namelen()const noexcept{
+        return len_;
+    }
 public:
+    IPAddr()noexcept{
+        ::memset(&addr_in_,0,sizeof(addr_in_));
+    }
     static IPAddr v4(const char* host,u_short port){
         IPAddr res;
         res.addr_in_.sin_family = AF_INET;
@@ -108,19 +170,140 @@ public:
         ::memcpy(&res.addr_in_,&addr_in,sizeof(sockaddr_in));
         return res;
     }
+#ifdef __linux__
+    // unix domain socket address
+    // a path starting with '@' is in the abstract namespace, no file is created
+    // fails with ENAMETOOLONG if the path does not fit into sun_path
+    static Result<IPAddr> local(std::string const& path){
+        IPAddr res;
+        ::memset(&res.addr_un_,0,sizeof(sockaddr_un));
+        res.addr_un_.sun_family = AF_UNIX;
+        // a file path keeps its terminating 0, an abstract name may use all of sun_path
+        bool abstract = !path.empty() && path[0] == '@';
+        size_t room = sizeof(res.addr_un_.sun_path)-(abstract?0:1);
+        if(path.size()>room){
+            return Result<IPAddr>(false,std::move(res),TMC_R_CALL_POS(ENAMETOOLONG));
+        }
+        size_t len = path.size();
+        ::memcpy(res.addr_un_.sun_path,path.data(),len);
+        if(len && path[0] == '@'){
+            res.addr_un_.sun_path[0] = 0;
+        }
+        res.type_ = Type::UNIX;
+        res.len_ = (int)(offsetof(sockaddr_un,sun_path)+len);
+        return Result<IPAddr>(true,std::move(res));
+    }
+#endif
+    // from an address filled by accept / getsockname etc
+    static IPAddr from_native(sockaddr const* _addr,int _len){
+        IPAddr res;
+#ifdef __linux__
+        if(_addr->sa_family == AF_UNIX){
+            int len = _len<(int)sizeof(sockaddr_un)?_len:(int)sizeof(sockaddr_un);
+            ::memcpy(&res.addr_un_,_addr,len);
+            res.type_ = Type::UNIX;
+            res.len_ = len;
+            return res;
+        }
+#endif
+        if(_addr->sa_family == AF_INET){
+            ::memcpy(&res.addr_in_,_addr,sizeof(sockaddr_in));
+        }
+        return res;
+    }
     Type type()const noexcept{
         return type_;
     }
+    // ip, or the path of a unix address ('@' first if abstract)
     std::string host()const{
+#ifdef __linux__
+        if(type_ == Type::UNIX){
+            int len = len_-(int)offsetof(sockaddr_un,sun_path);
+            if(len<=0){
+                return "";  // unnamed
+            }
+            std::string res(addr_un_.sun_path,len);
+            if(res[0] == 0){
+                res[0] = '@';
+            }else{
+                res.resize(::strnlen(res.data(),res.size()));
+            }
+            return res;
+        }
+#endif
         return ::inet_ntoa(addr_in_.sin_addr);
     }
+    // 0 for unix addresses
     u_short port()const noexcept{
-        return addr_in_.sin_port;
+        return type_ == Type::UNIX?0:addr_in_.sin_port;
+    }
+};
+
+
+// one udp datagram for batched io
+// data is storage owned by the caller, e.g. a DatagramBatch
+// size is the bytes used, addr the source on read or the target on write
+struct Datagram{
+    std::span<Byte> data;
+    size_t size = 0;
+    IPAddr addr;
+    bool truncated = false;     // did not fit into data on read
+};
+
+// n datagram buffers backed by one allocation
+// reuse it across Socket::read_batch_from calls so receiving allocates nothing
+class DatagramBatch{
+private:
+    std::unique_ptr<Byte[]> storage_;
+    std::vector<Datagram> dgs_;
+public:
+    DatagramBatch(size_t _count,size_t _each_size)
+        :storage_(new Byte[_count*_each_size])
+        ,dgs_(_count)
+    {
+        for(size_t i = 0;i<_count;i++){
+            dgs_[i].data = std::span<Byte>(storage_.get()+i*_each_size,_each_size);
+        }
+    }
+    Datagram& operator[](size_t pos){
+        return dgs_[pos];
+    }
+    size_t capacity()const noexcept{
+        return dgs_.size();
     }
+    std::span<Datagram> span(size_t _count = npos){
+        return std::span<Datagram>(dgs_.data(),_count<dgs_.size()?_count:dgs_.size());
+    }
+};
+
+
+// timestamps are CLOCK_REALTIME nanoseconds, comparable with system_clock
+// 0 means the kernel or the nic did not provide one
+
+// a read with the time the kernel (and nic) received it
+// see Socket::enable_timestamping and readsome_stamped
+struct ReadResult{
+    ByteBuf buf;
+    std::chrono::nanoseconds kernel_rx_ts{0};
+    std::chrono::nanoseconds hw_rx_ts{0};
 };
 
+// a send timestamp from the error queue, see Socket::reap_tx_timestamps
+struct TxTimestamp{
+    enum Kind: int{
+        SND = 0,    // handed to the driver / nic
+        SCHED = 1,  // entered the packet scheduler
+        ACK = 2,    // acked by the peer, tcp only
+    };
+    // counts bytes for tcp: offset of the last byte of the write
+    // counts sends for udp
+    uint32_t id = 0;
+    Kind kind = SND;
+    std::chrono::nanoseconds software{0};
+    std::chrono::nanoseconds hardware{0};
+};
 
-template<int _opt> struct GetSockOptDetails{
+template<int _opt,int _level> struct GetSockOptDetails{
     typedef void type;
     static const int level = -1;
     static const int optname = -1;
@@ -139,16 +322,190 @@ ROUTE_SOCK_OPT(SO_RCVTIMEO,SOL_SOCKET,timeval);
 ROUTE_SOCK_OPT(SO_SNDTIMEO,SOL_SOCKET,timeval);
 ROUTE_SOCK_OPT(SO_REUSEADDR,SOL_SOCKET,int);
 ROUTE_SOCK_OPT(SO_TYPE,SOL_SOCKET,int);
+#ifdef SO_PROTOCOL
+ROUTE_SOCK_OPT(SO_PROTOCOL,SOL_SOCKET,int);
+#endif
 
 // ROUTE_SOCK_OPT(IP_HDRINCL,IPPROTO_IP,int);
 // ROUTE_SOCK_OPT(IP_OPTINOS,IPPROTO_IP,int);
-// ROUTE_SOCK_OPT(IP_TOS,IPPROTO_IP,int);
+ROUTE_SOCK_OPT_AT(IP_TOS,IPPROTO_IP,int);
 // ROUTE_SOCK_OPT(IP_TTL,IPPROTO_IP,int);
 
 // ROUTE_SOCK_OPT(TCP_MAXSEG,IPPROTO_TCP,int);
 ROUTE_SOCK_OPT(TCP_NODELAY,IPPROTO_TCP,int);
+#ifdef TCP_QUICKACK
+ROUTE_SOCK_OPT(TCP_QUICKACK,IPPROTO_TCP,int);
+#endif
+#ifdef TCP_CORK
+ROUTE_SOCK_OPT_AT(TCP_CORK,IPPROTO_TCP,int);
+#endif
+#ifdef TCP_FASTOPEN
+ROUTE_SOCK_OPT(TCP_FASTOPEN,IPPROTO_TCP,int);
+#endif
+#ifdef SO_BUSY_POLL
+ROUTE_SOCK_OPT(SO_BUSY_POLL,SOL_SOCKET,int);
+#endif
+#ifdef SO_PREFER_BUSY_POLL
+ROUTE_SOCK_OPT(SO_PREFER_BUSY_POLL,SOL_SOCKET,int);
+ROUTE_SOCK_OPT(SO_BUSY_POLL_BUDGET,SOL_SOCKET,int);
+#endif
+#ifdef SO_REUSEPORT
+ROUTE_SOCK_OPT(SO_REUSEPORT,SOL_SOCKET,int);
+#endif
+
+#ifdef SO_ZEROCOPY
+ROUTE_SOCK_OPT(SO_ZEROCOPY,SOL_SOCKET,int);
+#endif
+#ifdef SO_TIMESTAMPING
+ROUTE_SOCK_OPT(SO_TIMESTAMPING,SOL_SOCKET,int);
+#endif
+#ifdef UDP_SEGMENT
+ROUTE_SOCK_OPT(UDP_SEGMENT,SOL_UDP,int);
+ROUTE_SOCK_OPT(UDP_GRO,SOL_UDP,int);
+#endif
+
+// socket options applied together by Socket::create or Socket::apply_profile
+// -1 leaves the system default
+// options the platform lacks are skipped
+struct SocketProfile{
+    int nodelay = -1;       // TCP_NODELAY, send small writes right away
+    int quickack = -1;      // TCP_QUICKACK, not sticky, the kernel may turn it off again
+    int cork = -1;          // TCP_CORK, hold partial frames until uncorked, see Socket::write_more
+    int fastopen = -1;      // TCP_FASTOPEN, queue length of a listener
+    int busy_poll = -1;     // SO_BUSY_POLL, microseconds to spin on an empty queue
+    int reuseport = -1;     // SO_REUSEPORT, set before bind
+    int write_bufsize = -1; // SO_SNDBUF
+    int read_bufsize = -1;  // SO_RCVBUF
+    int tos = -1;           // IP_TOS
+
+    // request / response traffic, small messages
+    static SocketProfile low_latency() noexcept{
+        SocketProfile res;
+        res.nodelay = 1;
+        res.quickack = 1;
+        res.busy_poll = 50;
+        res.tos = 0x10;     // IPTOS_LOWDELAY
+        return res;
+    }
+    // bulk transfer, big buffers
+    static SocketProfile high_throughput() noexcept{
+        SocketProfile res;
+        res.nodelay = 0;
+        res.write_bufsize = 4*1024*1024;
+        res.read_bufsize = 4*1024*1024;
+        res.tos = 0x08;     // IPTOS_THROUGHPUT
+        return res;
+    }
+};
+
+#ifdef __linux__
+
+// resumes the coroutines suspended in the async_ functions of Socket
+// an event loop sets itself as current() on its thread, see CoLoop in tmc_Coro.hpp
+class AsyncDriver{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    virtual ~AsyncDriver(){}
+    // call _cb(true) once _fd is ready for _events (POLLIN / POLLOUT)
+    // or _cb(false) if _deadline passes first
+    // one reader and one writer per fd at a time
+    virtual void wait(SOCKET _fd,short _events,TimePoint _deadline,std::function<void(bool)> _cb) = 0;
+
+    // the driver running on this thread, nullptr if none
+    static AsyncDriver*& current() noexcept{
+        thread_local AsyncDriver* driver = nullptr;
+        return driver;
+    }
+
+    // 0 means no deadline
+    static TimePoint deadline(std::chrono::milliseconds const& _timeout) noexcept{
+        if(_timeout == std::chrono::milliseconds(0)){
+            return TimePoint::max();
+        }
+        return std::chrono::steady_clock::now()+_timeout;
+    }
+};
+
+// awaitable returned by the async_ functions of Socket
+// _step(res,timed_out) tries the operation without blocking
+// and returns false while it would block, res is set once it returns true
+// without a current AsyncDriver it waits in poll on the calling thread
+template<typename _Res,typename _Step>
+class AsyncOp{
+private:
+    _Step step_;
+    SOCKET fd_;
+    short events_;
+    AsyncDriver::TimePoint deadline_;
+    AsyncDriver* driver_ = nullptr;
+    _Res res_{false};
+    std::coroutine_handle<> h_;
+
+    void __arm(){
+        driver_->wait(fd_,events_,deadline_,[this](bool _ready){
+            if(step_(res_,!_ready)){
+                h_.resume();
+            }else{
+                __arm();
+            }
+        });
+    }
+
+    void __block(){
+        while(true){
+            int ms = -1;
+            if(deadline_ != AsyncDriver::TimePoint::max()){
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline_-std::chrono::steady_clock::now());
+                ms = left.count()>0?(int)left.count():0;
+            }
+            pollfd pfd{fd_,events_,0};
+            int ret = ::poll(&pfd,1,ms);
+            if(ret == SOCKET_ERROR && errno != EINTR){
+                res_ = _Res(false,TMC_R_CALL_POS(errno));
+                return;
+            }
+            if(step_(res_,ret == 0)){
+                return;
+            }
+        }
+    }
+public:
+    AsyncOp(SOCKET _fd,short _events,std::chrono::milliseconds const& _timeout,_Step&& _step)
+        :step_(std::move(_step))
+        ,fd_(_fd)
+        ,events_(_events)
+        ,deadline_(AsyncDriver::deadline(_timeout))
+    {}
+
+    bool await_ready(){
+        if(step_(res_,false)){
+            return true;
+        }
+        driver_ = AsyncDriver::current();
+        if(!driver_){
+            __block();
+            return true;
+        }
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> _h){
+        h_ = _h;
+        __arm();
+    }
+    _Res await_resume(){
+        return std::move(res_);
+    }
+};
+
+#endif
 
 class Socket{
+#ifdef _WIN32
+    typedef WSABUF _IoVec;
+#elif defined(__linux__)
+    typedef iovec _IoVec;
+#endif
 public:
     enum class Protocol: int;
     enum class ShutdownType :int;
@@ -157,6 +514,8 @@ public:
         P_OTHER = -1,
         TCP = 0x00,
         UDP = 0x01,
+        UNIX_STREAM = 0x02,     // AF_UNIX, linux only
+        UNIX_SEQPACKET = 0x03,  // AF_UNIX with message boundaries, linux only
     };
     enum class ShutdownType :int{
         SDT_RECV = 0,
@@ -165,9 +524,42 @@ public:
     };
 private:
     bool valid_ = false;
+    bool nonblocking_ = false;
     SOCKET h_sock_ = INVALID_SOCKET;
-    Protocol protocol_;
+    Protocol protocol_ = Protocol::P_OTHER;
     IPAddr addr_;
+    // effective SO_SNDBUF / SO_RCVBUF, 0 until first read from the kernel
+    int write_bufsize_ = 0;
+    int read_bufsize_ = 0;
+    // the kernel refused UDP_SEGMENT once, write_segmented_to sends one by one
+    bool gso_refused_ = false;
+
+    // MSG_ZEROCOPY bookkeeping, shared by the copies of a Socket
+    struct _ZeroCopyState{
+        size_t threshold = 0;
+        uint32_t next_seq = 0;
+        std::deque<std::pair<uint32_t,ByteBuf>> pinned;     // seq of the last send of each buffer
+        std::function<void(ByteBuf&&,bool)> on_release;
+    };
+    std::shared_ptr<_ZeroCopyState> zc_;
+    // send timestamps read from the error queue, not reaped yet
+    std::shared_ptr<std::deque<TxTimestamp>> tx_stamps_;
+
+#ifdef __linux__
+    // pipe used by splice_to, created on first use
+    struct _SplicePipe{
+        int fds[2] = {-1,-1};
+        size_t pending = 0;     // read from the socket, not yet written to a target
+        ~_SplicePipe(){
+            if(fds[0] != -1) ::close(fds[0]);
+            if(fds[1] != -1) ::close(fds[1]);
+        }
+    };
+    std::shared_ptr<_SplicePipe> pipe_;
+#endif
+
+    // error results hold a default constructed Socket
+    template<typename ..._Types> friend class Result;
 
     Socket()noexcept {}//hide
     Socket(Protocol _protocol):protocol_(_protocol) {//hide
@@ -179,6 +571,16 @@ private:
         case Protocol::UDP:
             h_sock_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
             break;
+#ifdef __linux__
+        case Protocol::UNIX_STREAM:
+            h_sock_ = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+            break;
+        case Protocol::UNIX_SEQPACKET:
+            h_sock_ = ::socket(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+            break;
+#endif
+        default:
+            break;
         }
         if(h_sock_ != INVALID_SOCKET){
             this->valid_ = true;
@@ -191,6 +593,199 @@ private:
         }
     }
 
+    // poll this single socket
+    // one syscall, no fd_set, so it also works for fds above FD_SETSIZE
+    // param _timeout_ms < 0 wait forever, 0 return immediately
+    // return the revents
+    Result<short> __poll(short _events,int _timeout_ms){
+        pollfd pfd;
+        pfd.fd = h_sock_;
+        pfd.events = _events;
+        pfd.revents = 0;
+#ifdef _WIN32
+        int ret = ::WSAPoll(&pfd,1,_timeout_ms);
+#elif defined(__linux__)
+        int ret = ::poll(&pfd,1,_timeout_ms);
+#endif
+        if(ret == SOCKET_ERROR){
+            return Result<short>(false,0,TMC_R_CALL_POS(fast_err()));
+        }
+        return Result<short>(true,std::move(pfd.revents));
+    }
+
+    // wait for _events within what is left of _timeout since _start
+    // if timeout is 0 wait forever
+    // return ok(false) on time out
+    Result<bool> __await_left(short _events,std::chrono::steady_clock::time_point const& _start,std::chrono::milliseconds const& _timeout){
+        int _ms = -1;
+        if(_timeout != std::chrono::milliseconds(0)){
+            auto past_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _start);
+            if(_timeout<=past_time){
+                return Result<bool>::ok(false);
+            }
+            _ms = (int)(_timeout-past_time).count();
+        }
+        auto poll_res = __poll(_events,_ms);
+        if(!poll_res.check()){
+            return Result<bool>::err(false,TMC_R_CALL_POS(fast_err()));
+        }
+        return Result<bool>::ok(poll_res.ignore()!=0);
+    }
+
+    // error code of the call that just failed on this socket
+    // errno only, so success paths and most failures cost no extra syscall
+    // build with TMC_EXACT_ERR to prefer the pending SO_ERROR, one getsockopt more
+    int __err(){
+        int ec = fast_err();
+#ifdef TMC_EXACT_ERR
+        auto so_res = getopt<SO_ERROR>();
+        if(so_res.check() && so_res.ignore()){
+            return so_res.ignore();
+        }
+#endif
+        return ec;
+    }
+
+    // read the local address after connect succeeded
+    Result<void> __connected(){
+        sockaddr_storage storage;
+#ifdef __linux__
+        socklen_t sock_len = sizeof(sockaddr_storage);
+#elif defined(_WIN32)
+        int sock_len = sizeof(sockaddr_storage);
+#endif
+        int ret = ::getsockname(h_sock_,(sockaddr*)&storage,&sock_len);
+        if(ret == SOCKET_ERROR){
+            return {false,TMC_R_CALL_POS(__err())};
+        }
+        this->addr_ = IPAddr::from_native((sockaddr*)&storage,(int)sock_len);
+        return true;
+    }
+
+    // start a connect without blocking, switches the socket to non-blocking first
+    // param _restore set true if the socket was blocking before
+    // return ok(true) if connected at once, ok(false) if still in progress
+    Result<bool> __connect_start(IPAddr const& _addr,bool& _restore){
+        if(!nonblocking_){
+            auto nb_res = set_nonblocking(true);
+            if(!nb_res.check()){
+                return Result<bool>(false,false,TMC_R_CALL_POS(nb_res.error_code()));
+            }
+            _restore = true;
+        }
+        int ret = ::connect(h_sock_,_addr.__name(),_addr.__namelen());
+        if(ret != SOCKET_ERROR){
+            return Result<bool>::ok(true);
+        }
+        int ec = fast_err();
+        if(ec == EINPROGRESS || would_block(ec)){
+            return Result<bool>::ok(false);
+        }
+        return Result<bool>(false,false,TMC_R_CALL_POS(ec));
+    }
+
+    // outcome of a connect in progress, once the socket turned writable
+    Result<void> __connect_result(){
+        auto err_res = getopt<SO_ERROR>();
+        if(!err_res.check()){
+            return {false,TMC_R_CALL_POS(err_res.error_code())};
+        }
+        if(err_res.ignore()){
+            return {false,TMC_R_CALL_POS(err_res.ignore())};
+        }
+        return __connected();
+    }
+
+#ifdef __linux__
+    static std::chrono::nanoseconds __ns(timespec const& _ts) noexcept{
+        return std::chrono::nanoseconds((int64_t)_ts.tv_sec*1000000000+_ts.tv_nsec);
+    }
+#endif
+
+    // read the error queue until empty
+    // zerocopy completions release pinned buffers, send timestamps go to tx_stamps_
+    // return count of zerocopy buffers released
+    Result<int> __drain_errqueue(){
+        int released = 0;
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+        if(!zc_ && !tx_stamps_){
+            return Result<int>(true,std::move(released));
+        }
+        while(true){
+            alignas(cmsghdr) char control[256];
+            msghdr msg;
+            ::memset(&msg,0,sizeof(msg));
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if(::recvmsg(h_sock_,&msg,MSG_ERRQUEUE|MSG_DONTWAIT) == SOCKET_ERROR){
+                int ec = fast_err();
+                if(would_block(ec)){
+                    break;
+                }
+                return Result<int>(false,std::move(released),TMC_R_CALL_POS(ec));
+            }
+            scm_timestamping const* stamp = nullptr;
+            for(cmsghdr* cm = CMSG_FIRSTHDR(&msg);cm;cm = CMSG_NXTHDR(&msg,cm)){
+                if(cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING){
+                    stamp = (scm_timestamping const*)CMSG_DATA(cm);
+                    continue;
+                }
+                if(!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                    ||(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))){
+                    continue;
+                }
+                sock_extended_err const* ee = (sock_extended_err const*)CMSG_DATA(cm);
+                if(ee->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && stamp && tx_stamps_){
+                    TxTimestamp tx;
+                    tx.id = ee->ee_data;
+                    tx.kind = (TxTimestamp::Kind)ee->ee_info;     // SCM_TSTAMP_SND / SCHED / ACK
+                    tx.software = __ns(stamp->ts[0]);
+                    tx.hardware = __ns(stamp->ts[2]);
+                    tx_stamps_->push_back(tx);
+                    continue;
+                }
+                if(ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY || !zc_){
+                    continue;
+                }
+                // ee_info..ee_data is the range of completed sends
+                uint32_t hi = ee->ee_data;
+                bool copied = (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+                while(!zc_->pinned.empty() && (int32_t)(zc_->pinned.front().first-hi)<=0){
+                    ByteBuf done = std::move(zc_->pinned.front().second);
+                    zc_->pinned.pop_front();
+                    if(zc_->on_release){
+                        zc_->on_release(std::move(done),copied);
+                    }
+                    released++;
+                }
+            }
+        }
+#endif
+        return Result<int>(true,std::move(released));
+    }
+
+    // SO_SNDBUF / SO_RCVBUF asked once, then served from the cache
+    Result<int> __cached_write_bufsize(){
+        if(!write_bufsize_){
+            auto res = get_write_bufsize();
+            if(!res.check()){
+                return res;
+            }
+            write_bufsize_ = res.ignore();
+        }
+        return Result<int>(true,int(write_bufsize_));
+    }
+    Result<int> __cached_read_bufsize(){
+        if(!read_bufsize_){
+            auto res = get_read_bufsize();
+            if(!res.check()){
+                return res;
+            }
+            read_bufsize_ = res.ignore();
+        }
+        return Result<int>(true,int(read_bufsize_));
+    }
+
     // this func will call ::send or ::sendto
     // param buf content to send
     // param _fn function to call (send / sendto)
@@ -199,9 +794,9 @@ private:
     Result<int> __write(ByteBuf const& buf,_Fn &&_fn, _Args &&...args){
         int ret = _fn(h_sock_,(const char*)buf.view(),(int)buf.size(),MSG_NOSIGNAL,std::forward<_Args>(args)...);
         if(ret==SOCKET_ERROR){
-            return Result<int>(false,{0});
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
         }
-        return Result<int>(true,std::move(ret),TMC_R_CALL_POS(exact_err().ignore()));
+        return Result<int>(true,std::move(ret));
     }
 
     // this func will call ::send or ::sendto
@@ -209,59 +804,163 @@ private:
     // param _fn function to call (send / sendto)
     // param args if sendto, the target
     // make sure all buf has been write
+    // parks in poll while the send buffer is full, never spins
     template<typename _Fn,typename ..._Args>
     Result<void> __write_all(std::chrono::milliseconds const& _timeout,ByteBuf const& buf,_Fn &&_fn, _Args &&...args){
-        auto write_buf_size_res = get_write_bufsize();
+        auto start = std::chrono::steady_clock::now();
+        auto write_buf_size_res = __cached_write_bufsize();
         if(!write_buf_size_res.check()){
-            return {false,TMC_R_CALL_POS(exact_err().ignore())};
+            return {false,TMC_R_CALL_POS(fast_err())};
         }
         size_t write_buf_size = write_buf_size_res.ignore();
         const char* content = (const char*)buf.view();
         size_t offset = 0;
         size_t left_size = buf.size();
-
-        try_send:
-        if(left_size<write_buf_size){
-            while (!writeable().ignore());
-            int ret = ret = _fn(h_sock_,content+offset,(int)left_size,MSG_NOSIGNAL,std::forward<_Args>(args)...);
-            if(ret == SOCKET_ERROR)return false;
-            else if(left_size == ret){
-                return true;
-            }else{
-                offset+=ret;
-                left_size-=ret;
-                goto try_send;
+        // a blocking send parks in the kernel by itself
+        // only poll first when it has to give up after a timeout
+        bool wait_first = !nonblocking_ && _timeout != std::chrono::milliseconds(0);
+
+        while(left_size){
+            if(wait_first){
+                auto wait_res = __await_left(POLLOUT,start,_timeout);
+                if(!wait_res.check()){
+                    return {false,TMC_R_CALL_POS(fast_err())};
+                }else if(!wait_res.ignore()){
+                    return {false,TMC_R_CALL_POS(ETIMEDOUT)};
+                }
+            }
+            size_t send_size = left_size<write_buf_size?left_size:write_buf_size;
+            int ret = _fn(h_sock_,content+offset,(int)send_size,MSG_NOSIGNAL,std::forward<_Args>(args)...);
+            if(ret == SOCKET_ERROR){
+                int ec = fast_err();
+                if(!would_block(ec)){
+                    return {false,TMC_R_CALL_POS(ec)};
+                }
+                auto wait_res = __await_left(POLLOUT,start,_timeout);
+                if(!wait_res.check()){
+                    return {false,TMC_R_CALL_POS(fast_err())};
+                }else if(!wait_res.ignore()){
+                    return {false,TMC_R_CALL_POS(ETIMEDOUT)};
+                }
+                continue;
             }
-        }else{
-            while (!writeable().ignore());
-            int ret = _fn(h_sock_,content+offset,(int)write_buf_size,MSG_NOSIGNAL,std::forward<_Args>(args)...);
-            if(ret == SOCKET_ERROR)return {false,TMC_R_CALL_POS(exact_err().ignore())};
             offset+=ret;
             left_size-=ret;
-            goto try_send;
+        }
+        return true;
+    }
+
+    // fill iovecs from the segments of _chain, skipping the first _offset bytes
+    // return count of iovecs filled, at most TMC_IOV_BATCH
+    static size_t __fill_iov(_IoVec* _iov,BufferChain const& _chain,size_t _offset) noexcept{
+        size_t i = 0;
+        for(;i<_chain.count() && _offset>=_chain[i].size;i++){
+            _offset -= _chain[i].size;
+        }
+        size_t n = 0;
+        for(;i<_chain.count() && n<TMC_IOV_BATCH;i++,n++){
+#ifdef _WIN32
+            _iov[n].buf = (CHAR*)(_chain[i].data+_offset);
+            _iov[n].len = (ULONG)(_chain[i].size-_offset);
+#elif defined(__linux__)
+            _iov[n].iov_base = _chain[i].data+_offset;
+            _iov[n].iov_len = _chain[i].size-_offset;
+#endif
+            _offset = 0;
+        }
+        return n;
+    }
+
+    // gather the segments of _chain after _offset into one sendmsg
+    // param _to target of udp, nullptr for tcp
+    Result<int> __writev(BufferChain const& _chain,size_t _offset,sockaddr const* _to,int _to_len){
+        _IoVec iov[TMC_IOV_BATCH];
+        size_t n = __fill_iov(iov,_chain,_offset);
+#ifdef _WIN32
+        DWORD sent = 0;
+        int ret = ::WSASendTo(h_sock_,iov,(DWORD)n,&sent,0,_to,_to_len,nullptr,nullptr);
+        if(ret != SOCKET_ERROR){
+            ret = (int)sent;
+        }
+#elif defined(__linux__)
+        msghdr msg;
+        ::memset(&msg,0,sizeof(msg));
+        msg.msg_name = (void*)_to;
+        msg.msg_namelen = _to?(socklen_t)_to_len:0;
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        int ret = (int)::sendmsg(h_sock_,&msg,MSG_NOSIGNAL);
+#endif
+        if(ret == SOCKET_ERROR){
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
+        }
+        return Result<int>(true,std::move(ret));
+    }
+
+    // make sure all segments of _chain have been written
+    // parks in poll while the send buffer is full, like __write_all
+    Result<void> __writev_all(std::chrono::milliseconds const& _timeout,BufferChain const& _chain,sockaddr const* _to,int _to_len){
+        auto start = std::chrono::steady_clock::now();
+        size_t offset = 0;
+        bool wait_first = !nonblocking_ && _timeout != std::chrono::milliseconds(0);
+        while(offset<_chain.size()){
+            if(wait_first){
+                auto wait_res = __await_left(POLLOUT,start,_timeout);
+                if(!wait_res.check()){
+                    return {false,TMC_R_CALL_POS(fast_err())};
+                }else if(!wait_res.ignore()){
+                    return {false,TMC_R_CALL_POS(ETIMEDOUT)};
+                }
+            }
+            auto ret = __writev(_chain,offset,_to,_to_len);
+            if(!ret.check()){
+                if(!would_block(ret.error_code())){
+                    return {false,TMC_R_CALL_POS(ret.error_code())};
+                }
+                auto wait_res = __await_left(POLLOUT,start,_timeout);
+                if(!wait_res.check()){
+                    return {false,TMC_R_CALL_POS(fast_err())};
+                }else if(!wait_res.ignore()){
+                    return {false,TMC_R_CALL_POS(ETIMEDOUT)};
+                }
+                continue;
+            }
+            offset += ret.ignore();
         }
         return true;
     }
 
     // this func will call ::recv or ::recvfrom
-    // param buf content to send
+    // receives straight into the spare capacity of _buf, appends at most _size bytes
     // param _fn function to call (recv / recvfrom)
     // param args if recvfrom, the target
+    // return size read, 0 if the peer closed
     template<typename _Fn,typename ..._Args>
-    Result<ByteBuf> __readsome(int _expect_size,_Fn &&_fn, _Args &&...args){
-        std::unique_ptr<char> buf(new char[_expect_size]{0});
-        int ret = _fn(h_sock_,buf.get(),_expect_size,0,std::forward<_Args>(args)...);
+    Result<int> __recv_into(ByteBuf& _buf,int _size,_Fn &&_fn, _Args &&...args){
+        _buf.reserve(_buf.size()+_size);
+        int ret = _fn(h_sock_,(char*)_buf.spare(),_size,0,std::forward<_Args>(args)...);
         if(ret == SOCKET_ERROR){
-            return {false,TMC_R_CALL_POS(exact_err().ignore())};
+            // in non-blocking mode would_block(error_code()) means no data yet
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
         }
+        _buf.commit(ret);
+        return Result<int>(true,std::move(ret));
+    }
 
+    // this func will call ::recv or ::recvfrom
+    // param _fn function to call (recv / recvfrom)
+    // param args if recvfrom, the target
+    template<typename _Fn,typename ..._Args>
+    Result<ByteBuf> __readsome(int _expect_size,_Fn &&_fn, _Args &&...args){
         Result<ByteBuf> res(true);
-        res.ignore().ArrBuf<Byte>::push_back((Byte const*)buf.get(),ret);
+        auto ret = __recv_into(res.ignore(),_expect_size,std::forward<_Fn>(_fn),std::forward<_Args>(args)...);
+        if(!ret.check()){
+            return {false,TMC_R_CALL_POS(ret.error_code())};
+        }
         return res;
     }
 
     // this func will call ::recv or ::recvfrom
-    // param buf content to send
     // param _fn function to call (recv / recvfrom)
     // param args if recvfrom, the target
     // make sure all buf has been read
@@ -270,12 +969,15 @@ private:
     Result<ByteBuf> __readall(std::chrono::milliseconds const& _timeout,int _size,_Fn &&_fn, _Args &&...args){
         auto start = std::chrono::system_clock::now();
 
-        auto read_buf_size_res = get_read_bufsize();
+        auto read_buf_size_res = __cached_read_bufsize();
         if(!read_buf_size_res.check()){
-            return {false,TMC_R_CALL_POS(exact_err().ignore())};
+            return {false,TMC_R_CALL_POS(read_buf_size_res.error_code())};
         }
         int read_buf_size = read_buf_size_res.ignore();
         Result<ByteBuf> final_res(true);
+        if(_size>0){
+            final_res.ignore().reserve(_size);  // one allocation for the whole read
+        }
 
         bool wait_forever;
         if (_timeout == std::chrono::milliseconds(0)){
@@ -284,20 +986,16 @@ private:
             wait_forever = false;
         }
         
-        try_read:
-        if(_size<read_buf_size){
-            if(_size<=0){
-                return final_res;
-            }
+        while(_size>0){
             if(wait_forever){
-                if(!await_readable(_timeout).check()) return {false,TMC_R_CALL_POS(exact_err().ignore())};
+                if(!await_readable(_timeout).check()) return {false,TMC_R_CALL_POS(__err())};
             }else{
                 auto past_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start);
                 auto left_time = _timeout<=past_time?std::chrono::milliseconds(0):_timeout-past_time;
                 if(left_time != std::chrono::milliseconds(0)){
                     auto wait_res = await_readable(left_time);
                     if(!wait_res.check()){
-                        return {false,TMC_R_CALL_POS(exact_err().ignore())};// await error
+                        return {false,TMC_R_CALL_POS(__err())};// await error
                     }else if(!wait_res.ignore()){// await time out
                         return final_res;
                     }
@@ -305,48 +1003,21 @@ private:
                     return final_res;
                 }
             }
-            std::unique_ptr<char> buf(new char[_size]{0});
-            int ret =  _fn(h_sock_,buf.get(),_size,0,std::forward<_Args>(args)...);
+            ByteBuf& buf = final_res.ignore();
+            int want = _size<read_buf_size?_size:read_buf_size;
+            int ret =  _fn(h_sock_,(char*)buf.spare(),want,0,std::forward<_Args>(args)...);
             if(ret == SOCKET_ERROR){
-                return false;
-            }else{
-                final_res.ignore().ArrBuf<Byte>::push_back((Byte const*)buf.get(),ret);
-            }
-            if(ret <_size){
-                _size-=ret;
-                goto try_read;
-            }else{
-                return final_res;
-            }
-        }else{
-            if(wait_forever){
-                if(!await_readable(_timeout).check()) return {false,TMC_R_CALL_POS(exact_err().ignore())};
-            }else{
-                auto past_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start);
-                auto left_time = _timeout<=past_time?std::chrono::milliseconds(0):_timeout-past_time;
-                if(left_time != std::chrono::milliseconds(0)){
-                    auto wait_res = await_readable(left_time);
-                    if(!wait_res.check()){
-                        return false;// await error
-                    }else if(!wait_res.ignore()){// await time out
-                        return final_res;
-                    }
-                }else{// await time out
-                    return final_res;
+                if(would_block(fast_err())){
+                    continue;  // woken up too early, wait again
                 }
+                return {false,TMC_R_CALL_POS(fast_err())};
+            }else if(ret == 0){
+                return final_res;   // peer closed
             }
-            std::unique_ptr<char> buf(new char[_size]{0});
-            int ret =  _fn(h_sock_,buf.get(),read_buf_size,0,std::forward<_Args>(args)...);
-            if(ret == SOCKET_ERROR){
-                return {false,TMC_R_CALL_POS(exact_err().ignore())};
-            }else{
-                final_res.ignore().ArrBuf<Byte>::push_back((Byte const*)buf.get(),ret);
-            }
+            buf.commit(ret);
             _size-=ret;
-            goto try_read;
         }
-
-        return {false,TMC_R_CALL_POS(fast_err())};
+        return final_res;
     }
 
 
@@ -377,18 +1048,77 @@ public:
     // create a socket
     static Result<Socket> create(Protocol _protocol){
         Socket res(_protocol);
-        return Result<Socket>(res.valid_,std::move(res),TMC_R_CALL_POS(fast_err()));
+        return Result<Socket>(res.valid_,std::move(res),TMC_R_CALL_POS(res.valid_?0:fast_err()));
     }
     
+    // create a socket and apply _profile to it
+    static Result<Socket> create(Protocol _protocol,SocketProfile const& _profile){
+        Socket res(_protocol);
+        if(!res.valid_){
+            return Result<Socket>(false,std::move(res),TMC_R_CALL_POS(fast_err()));
+        }
+        auto apply_res = res.apply_profile(_profile);
+        if(!apply_res.check()){
+            res.close().ignore();
+            return Result<Socket>(false,std::move(res),TMC_R_CALL_POS(apply_res.error_code()));
+        }
+        return Result<Socket>(true,std::move(res));
+    }
+
     // create a socket in native style
     static Result<Socket> create(int af,int type, int _protocol){
         Socket res(af,type,_protocol);
-        return Result<Socket>(res.valid_,std::move(res),TMC_R_CALL_POS(fast_err()));
+        return Result<Socket>(res.valid_,std::move(res),TMC_R_CALL_POS(res.valid_?0:fast_err()));
     }
 
-    // check if the socket is valid currently
-    bool valid()const noexcept{
-        return this->valid_;
+#ifdef __linux__
+    // two connected unix sockets, e.g. to talk to a child process
+    static Result<Socket,Socket> pair(Protocol _protocol = Protocol::UNIX_STREAM){
+        int type = _protocol == Protocol::UNIX_SEQPACKET?SOCK_SEQPACKET:SOCK_STREAM;
+        int fds[2];
+        Socket first;
+        Socket second;
+        if(::socketpair(AF_UNIX,type|SOCK_CLOEXEC,0,fds) == SOCKET_ERROR){
+            return Result<Socket,Socket>(false,std::make_tuple(std::move(first),std::move(second)),TMC_R_CALL_POS(fast_err()));
+        }
+        first.protocol_ = second.protocol_ = _protocol;
+        first.h_sock_ = fds[0];
+        second.h_sock_ = fds[1];
+        first.valid_ = second.valid_ = true;
+        first.addr_.type_ = second.addr_.type_ = IPAddr::Type::UNIX;
+        return Result<Socket,Socket>(true,std::make_tuple(std::move(first),std::move(second)));
+    }
+#endif
+
+    // wrap a native socket handle, e.g. one accepted by io_uring
+    // the address is read by getpeername, or getsockname if not connected
+    static Result<Socket> from_native(SOCKET _handle,Protocol _protocol = Protocol::P_OTHER){
+        Socket res;
+        res.protocol_ = _protocol;
+        res.h_sock_ = _handle;
+        res.valid_ = _handle != INVALID_SOCKET;
+        if(res.valid_){
+            sockaddr_storage storage;
+#ifdef __linux__
+            socklen_t sock_len = sizeof(sockaddr_storage);
+#elif defined(_WIN32)
+            int sock_len = sizeof(sockaddr_storage);
+#endif
+            int ret = ::getpeername(_handle,(sockaddr*)&storage,&sock_len);
+            if(ret == SOCKET_ERROR){
+                sock_len = sizeof(sockaddr_storage);
+                ret = ::getsockname(_handle,(sockaddr*)&storage,&sock_len);
+            }
+            if(ret != SOCKET_ERROR){
+                res.addr_ = IPAddr::from_native((sockaddr*)&storage,(int)sock_len);
+            }
+        }
+        return Result<Socket>(res.valid_,std::move(res),TMC_R_CALL_POS(res.valid_?0:EBADF));
+    }
+
+    // check if the socket is valid currently
+    bool valid()const noexcept{
+        return this->valid_;
     }
     
     // get the errno on linux or the result of GetLastError on windows
@@ -398,6 +1128,39 @@ public:
         return sys_errno();
     }
     
+    // check if an error number only means the call would have blocked
+    // happens in non-blocking mode, retry when the socket is ready
+    static bool would_block(int _ec) noexcept{
+#ifdef _WIN32
+        return _ec == WSAEWOULDBLOCK;
+#elif defined(__linux__)
+        return _ec == EAGAIN || _ec == EWOULDBLOCK;
+#endif
+    }
+
+    // switch O_NONBLOCK on or off
+    // non-blocking: write / readsome return their progress right away
+    // and fail with would_block when nothing can be done
+    // write_all / readall park in poll until the socket is ready
+    Result<void> set_nonblocking(bool _nonblocking){
+#ifdef _WIN32
+        u_long mode = _nonblocking?1:0;
+        bool success = ::ioctlsocket(h_sock_,FIONBIO,&mode) != SOCKET_ERROR;
+#elif defined(__linux__)
+        int flags = ::fcntl(h_sock_,F_GETFL,0);
+        bool success = flags != -1 
+            && ::fcntl(h_sock_,F_SETFL,_nonblocking?(flags|O_NONBLOCK):(flags&~O_NONBLOCK)) != -1;
+#endif
+        if(success){
+            nonblocking_ = _nonblocking;
+        }
+        return {success,TMC_R_CALL_POS(success?0:fast_err())};
+    }
+
+    bool is_nonblocking()const noexcept{
+        return nonblocking_;
+    }
+
     // get the native socket handle 
     SOCKET native_handle()const noexcept{
         return h_sock_;
@@ -416,25 +1179,122 @@ public:
     // socet connect function
     // only valid for tcp
     Result<void> connect(IPAddr const& addr){
-        int ret = ::connect(h_sock_,(sockaddr*)&addr.addr_in_,sizeof(sockaddr_in));
+        int ret = ::connect(h_sock_,addr.__name(),addr.__namelen());
         
         if(ret!= SOCKET_ERROR){
-            sockaddr_storage storage;
-#ifdef __linux__
-            socklen_t sock_len = sizeof(sockaddr_storage);
-#elif defined(_WIN32)
-            int sock_len = sizeof(sockaddr_storage);
+            return __connected();
+        }else{
+            return {false,TMC_R_CALL_POS(fast_err())};
+        }
+    }
+
+    // connect, giving up with ETIMEDOUT after _timeout
+    // a dead peer no longer stalls the caller for the whole SYN retry period
+    // the socket keeps its blocking mode
+    // if timeout is 0 wait forever
+    Result<void> connect(IPAddr const& addr,std::chrono::milliseconds const& _timeout){
+        bool restore = false;
+        auto start = std::chrono::steady_clock::now();
+        auto start_res = __connect_start(addr,restore);
+        Result<void> res(true);
+        if(!start_res.check()){
+            res = Result<void>(false,TMC_R_CALL_POS(start_res.error_code()));
+        }else if(start_res.ignore()){
+            res = __connected();
+        }else{
+            auto wait_res = __await_left(POLLOUT,start,_timeout);
+            if(!wait_res.check()){
+                res = Result<void>(false,TMC_R_CALL_POS(wait_res.error_code()));
+            }else if(!wait_res.ignore()){
+                res = Result<void>(false,TMC_R_CALL_POS(ETIMEDOUT));
+            }else{
+                res = __connect_result();
+            }
+        }
+        if(restore){
+            set_nonblocking(false).ignore();
+        }
+        return res;
+    }
+
+    // race a connect to every address, keep the first that succeeds
+    // the other attempts are closed, the winner is in blocking mode
+    // fails with the last error seen, or ETIMEDOUT
+    // if timeout is 0 wait forever
+    static Result<Socket> dial_any(std::span<IPAddr const> _addrs,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0),Protocol _protocol = Protocol::TCP){
+        auto start = std::chrono::steady_clock::now();     // issuing the connects counts against _timeout
+        std::vector<Socket> socks;
+        std::vector<pollfd> pfds;
+        socks.reserve(_addrs.size());
+        pfds.reserve(_addrs.size());
+        int last_ec = ETIMEDOUT;
+        auto close_all = [&](size_t _keep){
+            for(size_t i = 0;i<socks.size();i++){
+                if(i != _keep && socks[i].valid_) socks[i].close().ignore();
+            }
+        };
+        auto win = [&](size_t _pos)->Result<Socket>{
+            close_all(_pos);
+            Socket& res = socks[_pos];
+            res.set_nonblocking(false).ignore();
+            return Result<Socket>(true,std::move(res));
+        };
+        for(auto const& addr:_addrs){
+            Socket sock(_protocol);
+            if(!sock.valid_){
+                last_ec = fast_err();
+                continue;
+            }
+            bool restore = false;
+            auto start_res = sock.__connect_start(addr,restore);
+            if(!start_res.check()){
+                last_ec = start_res.error_code();
+                sock.close().ignore();
+                continue;
+            }
+            socks.push_back(std::move(sock));
+            pfds.push_back(pollfd{socks.back().h_sock_,POLLOUT,0});
+            if(start_res.ignore() && socks.back().__connected().check()){
+                return win(socks.size()-1);
+            }
+        }
+        size_t pending = socks.size();
+        while(pending){
+            int ms = -1;
+            if(_timeout != std::chrono::milliseconds(0)){
+                auto past_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                if(_timeout<=past_time){
+                    last_ec = ETIMEDOUT;
+                    break;
+                }
+                ms = (int)(_timeout-past_time).count();
+            }
+#ifdef _WIN32
+            int ret = ::WSAPoll(pfds.data(),(ULONG)pfds.size(),ms);
+#elif defined(__linux__)
+            int ret = ::poll(pfds.data(),(nfds_t)pfds.size(),ms);
 #endif
-            ret = ::getsockname(h_sock_,(sockaddr*)&storage,&sock_len);
             if(ret == SOCKET_ERROR){
-                return {false,TMC_R_CALL_POS(exact_err().ignore())};
-            }else{
-                this->addr_ = IPAddr::v4(*((sockaddr_in*)&storage));
-                return true;
+                if(fast_err() == EINTR) continue;
+                last_ec = fast_err();
+                break;
+            }
+            for(size_t i = 0;i<pfds.size();i++){
+                if(!pfds[i].revents){
+                    continue;
+                }
+                auto res = socks[i].__connect_result();
+                if(res.check()){
+                    return win(i);
+                }
+                last_ec = res.error_code();
+                socks[i].close().ignore();
+                pfds[i].fd = INVALID_SOCKET;    // poll skips negative fds
+                pending--;
             }
-        }else{
-            return {false,TMC_R_CALL_POS(fast_err())};
         }
+        close_all(npos);
+        return Result<Socket>(false,TMC_R_CALL_POS(last_ec));
     }
     
     // socet sut down function
@@ -449,41 +1309,76 @@ public:
         if(ret!=SOCKET_ERROR){
             this->valid_ = false;
         }
-        return {ret!=SOCKET_ERROR,TMC_R_CALL_POS(exact_err().ignore())};
+        return {ret!=SOCKET_ERROR,TMC_R_CALL_POS(ret!=SOCKET_ERROR?0:__err())};
     }
     
     // socket bind function
     Result<void> bind(IPAddr const& addr){
-        bool success = ::bind(h_sock_,(sockaddr*)&addr.addr_in_,sizeof(sockaddr_in)) != SOCKET_ERROR;
+        bool success = ::bind(h_sock_,addr.__name(),addr.__namelen()) != SOCKET_ERROR;
         this->addr_ = addr;
-        return {success,TMC_R_CALL_POS(exact_err().ignore())};
+        return {success,TMC_R_CALL_POS(success?0:__err())};
     }
     
     // socket listen function
-    Result<void> listen(){
-        return {::listen(h_sock_,1)!=SOCKET_ERROR,TMC_R_CALL_POS(exact_err().ignore())};
+    // param _backlog queue length of connections not accepted yet
+    Result<void> listen(int _backlog = SOMAXCONN){
+        bool success = ::listen(h_sock_,_backlog)!=SOCKET_ERROR;
+        return {success,TMC_R_CALL_POS(success?0:__err())};
     }
     
     // socket accept function
     Result<Socket> accept(){
-        Socket res(this->protocol_);
-        sockaddr_in addr;
+        Socket res;
+        res.protocol_ = this->protocol_;
+        sockaddr_storage addr;
 #ifdef __linux__
-        socklen_t addr_len = sizeof(sockaddr_in);
+        socklen_t addr_len = sizeof(sockaddr_storage);
 #elif defined(_WIN32)
-        int addr_len = sizeof(sockaddr_in);
+        int addr_len = sizeof(sockaddr_storage);
 #endif
         res.h_sock_ =  ::accept(h_sock_,(sockaddr*)&addr,&addr_len);
         if(res.h_sock_ != INVALID_SOCKET){
             res.valid_ = true;
+            res.addr_ = IPAddr::from_native((sockaddr*)&addr,(int)addr_len);
         }
-        memcpy(&(res.addr_.addr_in_),&addr,sizeof(sockaddr_in));
-        if(res.addr_.addr_in_.sin_family == AF_INET){
-            res.addr_.type_ = IPAddr::Type::V4;
-        }else if(res.addr_.addr_in_.sin_family == AF_INET6){
-            res.addr_.type_ = IPAddr::Type::V6;
+        return Result<Socket>(res.valid_,std::move(res),TMC_R_CALL_POS(res.valid_?0:__err()));
+    }
+
+    // accept every pending connection, at most _max, into _out
+    // the listener should be non-blocking, else this blocks after the queue drained
+    // return count accepted, fails only when the first accept fails
+    Result<int> accept_batch(std::vector<Socket>& _out,size_t _max = npos){
+        int count = 0;
+        while((size_t)count<_max){
+            sockaddr_storage addr;
+#ifdef __linux__
+            socklen_t addr_len = sizeof(sockaddr_storage);
+            SOCKET fd = ::accept4(h_sock_,(sockaddr*)&addr,&addr_len,SOCK_CLOEXEC);
+#elif defined(_WIN32)
+            int addr_len = sizeof(sockaddr_storage);
+            SOCKET fd = ::accept(h_sock_,(sockaddr*)&addr,&addr_len);
+#endif
+            if(fd == INVALID_SOCKET){
+                int ec = fast_err();
+#ifdef __linux__
+                if(ec == EINTR || ec == ECONNABORTED){
+                    continue;
+                }
+#endif
+                if(count || would_block(ec)){
+                    break;
+                }
+                return Result<int>(false,0,TMC_R_CALL_POS(ec));
+            }
+            Socket res;
+            res.protocol_ = this->protocol_;
+            res.h_sock_ = fd;
+            res.valid_ = true;
+            res.addr_ = IPAddr::from_native((sockaddr*)&addr,(int)addr_len);
+            _out.push_back(std::move(res));
+            count++;
         }
-        return Result<Socket>(res.valid_,std::move(res),TMC_R_CALL_POS(exact_err().ignore()));
+        return Result<int>(true,std::move(count));
     }
     
     // socket send funtion
@@ -503,15 +1398,569 @@ public:
     // param 0 message to write
     // param 1 target of udp
     Result<int> write_to(ByteBuf const& buf,IPAddr const& tar){
-        return __write(buf,::sendto,(sockaddr*)&tar.addr_in_,(int)sizeof(sockaddr_in));
+        return __write(buf,::sendto,tar.__name(),tar.__namelen());
     }
     
     // make sure write all the buffer content
     Result<void> write_all_to(ByteBuf const& buf, IPAddr const& tar,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
-        return __write_all(_timeout,buf,::sendto,(sockaddr*)&tar.addr_in_,(int)sizeof(sockaddr_in));
+        return __write_all(_timeout,buf,::sendto,tar.__name(),tar.__namelen());
     }
 
 
+    // gather write, all segments go out with one sendmsg
+    // return size writen
+    Result<int> write(BufferChain const& chain){
+        return __writev(chain,0,nullptr,0);
+    }
+
+    // make sure write all the segments, no concatenation copies
+    Result<void> write_all(BufferChain const& chain,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        return __writev_all(_timeout,chain,nullptr,0);
+    }
+
+    // gather write of one udp datagram
+    // at most TMC_IOV_BATCH segments fit into one datagram, more fails with EMSGSIZE
+    Result<void> write_all_to(BufferChain const& chain,IPAddr const& tar,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        if(chain.count()>TMC_IOV_BATCH){
+            // a second sendmsg would send the rest as another datagram
+            return {false,TMC_R_CALL_POS(EMSGSIZE)};
+        }
+        return __writev_all(_timeout,chain,tar.__name(),tar.__namelen());
+    }
+
+    // scatter read into the segments of chain with one recvmsg
+    // return size read, 0 if the peer closed
+    // fails with EINVAL if a segment is read only (ByteBuf, ByteView, span<Byte const>)
+    Result<int> read_into(BufferChain& chain){
+        if(!chain.writable()){
+            return Result<int>(false,0,TMC_R_CALL_POS(EINVAL));
+        }
+        _IoVec iov[TMC_IOV_BATCH];
+        size_t n = __fill_iov(iov,chain,0);
+#ifdef _WIN32
+        DWORD recved = 0;
+        DWORD flags = 0;
+        int ret = ::WSARecv(h_sock_,iov,(DWORD)n,&recved,&flags,nullptr,nullptr);
+        if(ret != SOCKET_ERROR){
+            ret = (int)recved;
+        }
+#elif defined(__linux__)
+        msghdr msg;
+        ::memset(&msg,0,sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        int ret = (int)::recvmsg(h_sock_,&msg,0);
+#endif
+        if(ret == SOCKET_ERROR){
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
+        }
+        return Result<int>(true,std::move(ret));
+    }
+
+    // turn on MSG_ZEROCOPY for write_zerocopy
+    // buffers smaller than _threshold are still copied, pinning them costs more
+    Result<void> enable_zerocopy(size_t _threshold = 16384){
+#ifdef SO_ZEROCOPY
+        auto res = setopt<SO_ZEROCOPY>(1);
+        if(res.check()){
+            if(!zc_){
+                zc_ = std::make_shared<_ZeroCopyState>();
+            }
+            zc_->threshold = _threshold;
+        }
+        return res;
+#else
+        return {false,TMC_R_CALL_POS(ENOTSUP)};
+#endif
+    }
+
+    // called once the kernel is done with a buffer of write_zerocopy
+    // the buffer is handed back, e.g. to reuse its memory
+    // param copied the kernel copied it anyway (always true on loopback)
+    void on_zerocopy_release(std::function<void(ByteBuf&&,bool)> const& _cb){
+        if(zc_){
+            zc_->on_release = _cb;
+        }
+    }
+
+    // count of buffers still pinned by the kernel
+    size_t pending_zerocopy()const noexcept{
+        return zc_?zc_->pinned.size():0;
+    }
+
+    // send the whole buffer without copying it into the kernel
+    // the buffer stays pinned in this socket until reap_zerocopy sees its completion
+    // falls back to write_all below the threshold or if enable_zerocopy was not called
+    // return ok(true) if pinned, ok(false) if copied
+    Result<bool> write_zerocopy(ByteBuf&& buf,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        if(!zc_ || buf.size()<zc_->threshold || buf.is_inline()){
+            auto res = write_all(buf,_timeout);
+            return Result<bool>(res.check(),false,TMC_R_CALL_POS(res.error_code()));
+        }
+#ifdef MSG_ZEROCOPY
+        auto start = std::chrono::steady_clock::now();
+        ByteBuf pinned = std::move(buf);    // moving keeps heap storage in place, inline ones were copied above
+        const char* content = (const char*)pinned.view();
+        size_t offset = 0;
+        bool sent_any = false;
+        uint32_t last_seq = 0;
+        int ec = 0;
+        while(offset<pinned.size()){
+            int ret = ::send(h_sock_,content+offset,(int)(pinned.size()-offset),MSG_NOSIGNAL|MSG_ZEROCOPY);
+            if(ret == SOCKET_ERROR){
+                ec = fast_err();
+                if(ec == ENOBUFS){
+                    reap_zerocopy().ignore();    // too many notifications queued
+                }else if(!would_block(ec)){
+                    break;
+                }
+                auto wait_res = __await_left(POLLOUT,start,_timeout);
+                if(!wait_res.check() || !wait_res.ignore()){
+                    ec = wait_res.check()?ETIMEDOUT:fast_err();
+                    break;
+                }
+                ec = 0;
+                continue;
+            }
+            // every successful zerocopy send takes one completion number
+            last_seq = zc_->next_seq++;
+            sent_any = true;
+            offset += ret;
+        }
+        if(sent_any){
+            zc_->pinned.emplace_back(last_seq,std::move(pinned));
+        }
+        if(ec){
+            return Result<bool>(false,std::move(sent_any),TMC_R_CALL_POS(ec));
+        }
+        return Result<bool>(true,true);
+#else
+        auto res = write_all(buf,_timeout);
+        return Result<bool>(res.check(),false,TMC_R_CALL_POS(res.error_code()));
+#endif
+    }
+
+    // read MSG_ZEROCOPY completions from the error queue
+    // and release the buffers the kernel is done with
+    // call it when the socket reports an error event (POLLERR / Reactor::EV_ERROR)
+    // send timestamps read on the way are kept for reap_tx_timestamps
+    // return count of buffers released
+    Result<int> reap_zerocopy(){
+        return __drain_errqueue();
+    }
+
+#ifdef SO_TIMESTAMPING
+    // ask the kernel for receive and send timestamps
+    // software stamps always, plus nic stamps with _hardware if the driver has them
+    // rx stamps come with readsome_stamped, tx stamps with reap_tx_timestamps
+    Result<void> enable_timestamping(bool _rx = true,bool _tx = true,bool _hardware = false){
+        int flags = SOF_TIMESTAMPING_SOFTWARE;
+        if(_rx){
+            flags |= SOF_TIMESTAMPING_RX_SOFTWARE;
+            if(_hardware) flags |= SOF_TIMESTAMPING_RX_HARDWARE;
+        }
+        if(_tx){
+            flags |= SOF_TIMESTAMPING_TX_SOFTWARE|SOF_TIMESTAMPING_TX_SCHED|SOF_TIMESTAMPING_OPT_ID|SOF_TIMESTAMPING_OPT_TSONLY;
+            if(protocol_ == Protocol::TCP) flags |= SOF_TIMESTAMPING_TX_ACK;
+            if(_hardware) flags |= SOF_TIMESTAMPING_TX_HARDWARE;
+        }
+        if(_hardware){
+            flags |= SOF_TIMESTAMPING_RAW_HARDWARE;
+        }
+        auto res = setopt<SO_TIMESTAMPING>(flags);
+        if(res.check() && _tx && !tx_stamps_){
+            tx_stamps_ = std::make_shared<std::deque<TxTimestamp>>();
+        }
+        return res;
+    }
+
+    // readsome, plus the receive timestamps of the data
+    // with tcp the stamps belong to the last skb read
+    Result<ReadResult> readsome_stamped(int _expect_size){
+        ReadResult rr;
+        rr.buf.reserve(_expect_size);
+        iovec iov;
+        iov.iov_base = rr.buf.spare();
+        iov.iov_len = _expect_size;
+        alignas(cmsghdr) char control[256];
+        msghdr msg;
+        ::memset(&msg,0,sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        int ret = (int)::recvmsg(h_sock_,&msg,0);
+        if(ret == SOCKET_ERROR){
+            return {false,TMC_R_CALL_POS(fast_err())};
+        }
+        rr.buf.commit(ret);
+        for(cmsghdr* cm = CMSG_FIRSTHDR(&msg);cm;cm = CMSG_NXTHDR(&msg,cm)){
+            if(cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING){
+                scm_timestamping const* ts = (scm_timestamping const*)CMSG_DATA(cm);
+                rr.kernel_rx_ts = __ns(ts->ts[0]);
+                rr.hw_rx_ts = __ns(ts->ts[2]);
+            }
+        }
+        return Result<ReadResult>(true,std::move(rr));
+    }
+
+    // move the send timestamps that arrived so far into _out
+    // return count added
+    Result<int> reap_tx_timestamps(std::vector<TxTimestamp>& _out){
+        auto res = __drain_errqueue();
+        int count = 0;
+        if(tx_stamps_){
+            while(!tx_stamps_->empty()){
+                _out.push_back(tx_stamps_->front());
+                tx_stamps_->pop_front();
+                count++;
+            }
+        }
+        return Result<int>(res.check(),std::move(count),TMC_R_CALL_POS(res.error_code()));
+    }
+#endif
+
+    // send _len bytes of file _fd from _offset with sendfile
+    // the file content never goes through user space
+    // parks in poll while the send buffer is full
+    // return size sent, less than _len if the file ended first
+    Result<size_t> send_file(int _fd,int64_t _offset,size_t _len,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        size_t sent = 0;
+#ifdef __linux__
+        auto start = std::chrono::steady_clock::now();
+        off_t offset = (off_t)_offset;
+        while(sent<_len){
+            ssize_t ret = ::sendfile(h_sock_,_fd,&offset,_len-sent);
+            if(ret == SOCKET_ERROR){
+                int ec = fast_err();
+                if(!would_block(ec)){
+                    return Result<size_t>(false,std::move(sent),TMC_R_CALL_POS(ec));
+                }
+                auto wait_res = __await_left(POLLOUT,start,_timeout);
+                if(!wait_res.check() || !wait_res.ignore()){
+                    return Result<size_t>(false,std::move(sent),TMC_R_CALL_POS(wait_res.check()?ETIMEDOUT:fast_err()));
+                }
+                continue;
+            }
+            if(ret == 0){
+                break;  // end of file
+            }
+            sent += ret;
+        }
+        return Result<size_t>(true,std::move(sent));
+#else
+        return Result<size_t>(false,std::move(sent),TMC_R_CALL_POS(ENOTSUP));
+#endif
+    }
+
+    // move up to _len bytes received on this socket to _target with splice
+    // through a pipe, the data never goes through user space
+    // with a timeout, blocking sockets are made non-blocking for the call so splice never sleeps past it
+    // bytes a failed or timed out call left in the pipe are written first by the next call
+    // return size moved, less than _len if this socket was closed by the peer
+    Result<size_t> splice_to(Socket& _target,size_t _len,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        size_t moved = 0;
+#ifdef __linux__
+        if(!pipe_){
+            pipe_ = std::make_shared<_SplicePipe>();
+            if(::pipe2(pipe_->fds,O_CLOEXEC|O_NONBLOCK) == SOCKET_ERROR){
+                int ec = fast_err();
+                pipe_.reset();
+                return Result<size_t>(false,std::move(moved),TMC_R_CALL_POS(ec));
+            }
+        }
+        // puts back the file flags changed for this call
+        struct _Flags{
+            int fd = -1;
+            int flags = -1;
+            ~_Flags(){
+                if(flags != -1) ::fcntl(fd,F_SETFL,flags);
+            }
+            void nonblock(int _fd){
+                int old = ::fcntl(_fd,F_GETFL,0);
+                if(old != -1 && !(old & O_NONBLOCK) && ::fcntl(_fd,F_SETFL,old|O_NONBLOCK) != -1){
+                    fd = _fd;
+                    flags = old;
+                }
+            }
+        } in_flags,out_flags;
+        if(_timeout != std::chrono::milliseconds(0)){
+            if(!nonblocking_) in_flags.nonblock(h_sock_);
+            if(!_target.nonblocking_) out_flags.nonblock(_target.h_sock_);
+        }
+        auto start = std::chrono::steady_clock::now();
+        // 0 when _sock is ready for _events, else the error code
+        auto wait = [&](Socket& _sock,short _events){
+            auto wait_res = _sock.__await_left(_events,start,_timeout);
+            return !wait_res.check()?fast_err():(!wait_res.ignore()?ETIMEDOUT:0);
+        };
+        // no SPLICE_F_MORE, the target would hold back the tail while this call waits for input
+        int flags = SPLICE_F_MOVE|SPLICE_F_NONBLOCK;
+        while(true){
+            // drain the pipe before reading more
+            while(pipe_->pending){
+                ssize_t out = ::splice(pipe_->fds[0],nullptr,_target.h_sock_,nullptr,pipe_->pending,flags);
+                if(out == SOCKET_ERROR){
+                    int ec = fast_err();
+                    if(would_block(ec)){
+                        ec = wait(_target,POLLOUT);
+                    }
+                    if(ec){
+                        return Result<size_t>(false,std::move(moved),TMC_R_CALL_POS(ec));
+                    }
+                    continue;
+                }
+                pipe_->pending -= out;
+                moved += out;
+            }
+            if(moved>=_len){
+                break;
+            }
+            ssize_t in = ::splice(h_sock_,nullptr,pipe_->fds[1],nullptr,_len-moved,flags);
+            if(in == SOCKET_ERROR){
+                int ec = fast_err();
+                if(would_block(ec)){
+                    ec = wait(*this,POLLIN);
+                }
+                if(ec){
+                    return Result<size_t>(false,std::move(moved),TMC_R_CALL_POS(ec));
+                }
+                continue;
+            }
+            if(in == 0){
+                break;  // peer closed
+            }
+            pipe_->pending = in;
+        }
+        return Result<size_t>(true,std::move(moved));
+#else
+        return Result<size_t>(false,std::move(moved),TMC_R_CALL_POS(ENOTSUP));
+#endif
+    }
+
+#ifdef __linux__
+    // co_await these inside a coroutine, they suspend instead of blocking the thread
+    // a CoLoop (tmc_Coro.hpp) running on this thread resumes them
+    // the socket, and buffers passed in, must outlive the co_await
+    // if timeout is 0 wait forever
+
+    // return ok(false) on time out
+    auto async_readable(std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        auto step = [this](Result<bool>& _res,bool _timed_out){
+            if(!_timed_out && !(__poll(POLLIN,0).ignore() & (POLLIN|POLLERR|POLLHUP))){
+                return false;
+            }
+            _res = Result<bool>::ok(!_timed_out);
+            return true;
+        };
+        return AsyncOp<Result<bool>,decltype(step)>(h_sock_,POLLIN,_timeout,std::move(step));
+    }
+
+    // return ok(false) on time out
+    auto async_writeable(std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        auto step = [this](Result<bool>& _res,bool _timed_out){
+            if(!_timed_out && !(__poll(POLLOUT,0).ignore() & (POLLOUT|POLLERR|POLLHUP))){
+                return false;
+            }
+            _res = Result<bool>::ok(!_timed_out);
+            return true;
+        };
+        return AsyncOp<Result<bool>,decltype(step)>(h_sock_,POLLOUT,_timeout,std::move(step));
+    }
+
+    // receive at most _size bytes, like readsome
+    // an empty buffer means the peer closed
+    auto async_read(int _size,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        auto step = [this,_size](Result<ByteBuf>& _res,bool _timed_out){
+            if(_timed_out){
+                _res = Result<ByteBuf>(false,TMC_R_CALL_POS(ETIMEDOUT));
+                return true;
+            }
+            ByteBuf buf;
+            auto ret = __recv_into(buf,_size,[](SOCKET _fd,char* _data,int _len,int _flags){
+                return (int)::recv(_fd,_data,_len,_flags|MSG_DONTWAIT);
+            });
+            if(!ret.check() && would_block(ret.error_code())){
+                return false;
+            }
+            _res = ret.check()?Result<ByteBuf>(true,std::move(buf)):Result<ByteBuf>(false,TMC_R_CALL_POS(ret.error_code()));
+            return true;
+        };
+        return AsyncOp<Result<ByteBuf>,decltype(step)>(h_sock_,POLLIN,_timeout,std::move(step));
+    }
+
+    // send the whole buffer
+    auto async_write_all(ByteBuf const& _buf,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        auto step = [this,&_buf,offset = size_t(0)](Result<void>& _res,bool _timed_out)mutable{
+            if(_timed_out){
+                _res = Result<void>(false,TMC_R_CALL_POS(ETIMEDOUT));
+                return true;
+            }
+            while(offset<_buf.size()){
+                ssize_t ret = ::send(h_sock_,_buf.view()+offset,_buf.size()-offset,MSG_NOSIGNAL|MSG_DONTWAIT);
+                if(ret == SOCKET_ERROR){
+                    int ec = fast_err();
+                    if(would_block(ec)){
+                        return false;
+                    }
+                    _res = Result<void>(false,TMC_R_CALL_POS(ec));
+                    return true;
+                }
+                offset += ret;
+            }
+            _res = Result<void>(true);
+            return true;
+        };
+        return AsyncOp<Result<void>,decltype(step)>(h_sock_,POLLOUT,_timeout,std::move(step));
+    }
+
+    // accept one connection
+    // a blocking listener shared with other threads may still block in accept
+    auto async_accept(std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        auto step = [this](Result<Socket>& _res,bool _timed_out){
+            if(_timed_out){
+                _res = Result<Socket>(false,TMC_R_CALL_POS(ETIMEDOUT));
+                return true;
+            }
+            if(!nonblocking_ && !(__poll(POLLIN,0).ignore() & (POLLIN|POLLERR|POLLHUP))){
+                return false;
+            }
+            auto res = accept();
+            if(!res.check() && would_block(res.error_code())){
+                return false;
+            }
+            _res = std::move(res);
+            return true;
+        };
+        return AsyncOp<Result<Socket>,decltype(step)>(h_sock_,POLLIN,_timeout,std::move(step));
+    }
+
+    // connect without blocking the thread
+    // the socket is non-blocking while connecting, then restored
+    auto async_connect(IPAddr const& _addr,std::chrono::milliseconds const& _timeout = std::chrono::milliseconds(0)){
+        auto step = [this,_addr,started = false,restore = false](Result<void>& _res,bool _timed_out)mutable{
+            auto finish = [&](Result<void>&& _r){
+                if(restore){
+                    set_nonblocking(false).ignore();
+                }
+                _res = std::move(_r);
+                return true;
+            };
+            if(!started){
+                started = true;
+                auto start_res = __connect_start(_addr,restore);
+                if(!start_res.check()){
+                    return finish(Result<void>(false,TMC_R_CALL_POS(start_res.error_code())));
+                }
+                if(start_res.ignore()){
+                    return finish(__connected());
+                }
+                return false;
+            }
+            if(_timed_out){
+                return finish(Result<void>(false,TMC_R_CALL_POS(ETIMEDOUT)));
+            }
+            if(!(__poll(POLLOUT,0).ignore() & (POLLOUT|POLLERR|POLLHUP))){
+                return false;
+            }
+            return finish(__connect_result());
+        };
+        return AsyncOp<Result<void>,decltype(step)>(h_sock_,POLLOUT,_timeout,std::move(step));
+    }
+#endif
+
+#ifdef __linux__
+    // pass open fds to the peer of a unix socket with SCM_RIGHTS
+    // e.g. hand listening and accepted sockets to a new process without dropping them
+    // the fds stay open here, close them once sent
+    // _data is sent along, stream sockets need at least one byte so empty sends a 0
+    // return size of _data sent
+    Result<int> send_fds(std::span<SOCKET const> _fds,ByteBuf const& _data = ByteBuf()){
+        if(_fds.size()>TMC_SCM_MAX_FDS){
+            return Result<int>(false,0,TMC_R_CALL_POS(EINVAL));
+        }
+        Byte zero = 0;
+        iovec iov;
+        iov.iov_base = _data.size()?(void*)_data.view():(void*)&zero;
+        iov.iov_len = _data.size()?_data.size():1;
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int)*TMC_SCM_MAX_FDS)];
+        msghdr msg;
+        ::memset(&msg,0,sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if(_fds.size()){
+            msg.msg_control = control;
+            msg.msg_controllen = CMSG_SPACE(sizeof(int)*_fds.size());
+            cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+            cm->cmsg_level = SOL_SOCKET;
+            cm->cmsg_type = SCM_RIGHTS;
+            cm->cmsg_len = CMSG_LEN(sizeof(int)*_fds.size());
+            ::memcpy(CMSG_DATA(cm),_fds.data(),sizeof(int)*_fds.size());
+        }
+        int ret = (int)::sendmsg(h_sock_,&msg,MSG_NOSIGNAL);
+        if(ret == SOCKET_ERROR){
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
+        }
+        return Result<int>(true,std::move(ret));
+    }
+
+    // receive fds sent by send_fds, wrap them with from_native
+    // _data gets the payload sent along, at most _max_data bytes
+    // fails with EMSGSIZE if more than TMC_SCM_MAX_FDS fds came, those are closed
+    Result<std::vector<SOCKET>> recv_fds(ByteBuf& _data,int _max_data = 1){
+        _data.reserve(_data.size()+_max_data);
+        iovec iov;
+        iov.iov_base = _data.spare();
+        iov.iov_len = _max_data;
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int)*TMC_SCM_MAX_FDS)];
+        msghdr msg;
+        ::memset(&msg,0,sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        int ret = (int)::recvmsg(h_sock_,&msg,MSG_CMSG_CLOEXEC);
+        if(ret == SOCKET_ERROR){
+            return {false,TMC_R_CALL_POS(fast_err())};
+        }
+        _data.commit(ret);
+        std::vector<SOCKET> fds;
+        for(cmsghdr* cm = CMSG_FIRSTHDR(&msg);cm;cm = CMSG_NXTHDR(&msg,cm)){
+            if(cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS){
+                continue;
+            }
+            size_t n = (cm->cmsg_len-CMSG_LEN(0))/sizeof(int);
+            size_t old_size = fds.size();
+            fds.resize(old_size+n);
+            ::memcpy(fds.data()+old_size,CMSG_DATA(cm),n*sizeof(int));
+        }
+        if(msg.msg_flags & MSG_CTRUNC){
+            for(SOCKET fd:fds){
+                ::close(fd);
+            }
+            return {false,TMC_R_CALL_POS(EMSGSIZE)};
+        }
+        return Result<std::vector<SOCKET>>(true,std::move(fds));
+    }
+#endif
+
+    // recv into the spare capacity of _buf, appends at most _max bytes
+    // no allocation once _buf has grown, reuse it with pop_back(size())
+    // return size read, 0 if the peer closed
+    Result<int> read_into(ByteBuf& _buf,int _max){
+        return __recv_into(_buf,_max,::recv);
+    }
+
+    // recv into caller owned memory, never allocates
+    // return size read, 0 if the peer closed
+    Result<int> read_into(std::span<Byte> _buf){
+        int ret = ::recv(h_sock_,(char*)_buf.data(),(int)_buf.size(),0);
+        if(ret == SOCKET_ERROR){
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
+        }
+        return Result<int>(true,std::move(ret));
+    }
+
     // socket recv function
     // param 0 size to read
     // if data in read buf is not enough will return ok(readsize)
@@ -545,101 +1994,269 @@ public:
         return __readall(_timeout,_expect_size,::recvfrom,(sockaddr*)&tar.addr_in_,&addr_len);
     }
 
+    // receive up to _dgs.size() datagrams with one recvmmsg
+    // blocks until at least one arrives (fails with would_block in non-blocking mode)
+    // return count received, each Datagram gets its size and source addr
+    Result<int> read_batch_from(std::span<Datagram> _dgs){
+        size_t n = _dgs.size()<TMC_MMSG_BATCH?_dgs.size():TMC_MMSG_BATCH;
+#ifdef __linux__
+        mmsghdr msgs[TMC_MMSG_BATCH];
+        iovec iov[TMC_MMSG_BATCH];
+        ::memset(msgs,0,sizeof(mmsghdr)*n);
+        for(size_t i = 0;i<n;i++){
+            iov[i].iov_base = _dgs[i].data.data();
+            iov[i].iov_len = _dgs[i].data.size();
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &_dgs[i].addr.addr_in_;
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        int ret = ::recvmmsg(h_sock_,msgs,(unsigned)n,MSG_WAITFORONE,nullptr);
+        if(ret == SOCKET_ERROR){
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
+        }
+        for(int i = 0;i<ret;i++){
+            _dgs[i].size = msgs[i].msg_len;
+            _dgs[i].truncated = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+            _dgs[i].addr.type_ = IPAddr::Type::V4;
+        }
+        return Result<int>(true,std::move(ret));
+#elif defined(_WIN32)
+        // no recvmmsg, one recvfrom per datagram, stop once nothing is left
+        int count = 0;
+        for(size_t i = 0;i<n;i++){
+            if(i && !readable().ignore()){
+                break;
+            }
+            int addr_len = sizeof(sockaddr_in);
+            int ret = ::recvfrom(h_sock_,(char*)_dgs[i].data.data(),(int)_dgs[i].data.size(),0,(sockaddr*)&_dgs[i].addr.addr_in_,&addr_len);
+            if(ret == SOCKET_ERROR){
+                if(count) break;
+                return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
+            }
+            _dgs[i].size = ret;
+            _dgs[i].truncated = false;
+            count++;
+        }
+        return Result<int>(true,std::move(count));
+#endif
+    }
+
+    // send the datagrams to their addr with as few sendmmsg calls as possible
+    // return count sent, less than _dgs.size() if the socket would block
+    Result<int> write_batch_to(std::span<Datagram const> _dgs){
+        int count = 0;
+#ifdef __linux__
+        mmsghdr msgs[TMC_MMSG_BATCH];
+        iovec iov[TMC_MMSG_BATCH];
+        while((size_t)count<_dgs.size()){
+            size_t left = _dgs.size()-count;
+            size_t n = left<TMC_MMSG_BATCH?left:TMC_MMSG_BATCH;
+            ::memset(msgs,0,sizeof(mmsghdr)*n);
+            for(size_t i = 0;i<n;i++){
+                Datagram const& dg = _dgs[count+i];
+                iov[i].iov_base = dg.data.data();
+                iov[i].iov_len = dg.size;
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_name = (void*)&dg.addr.addr_in_;
+                msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            }
+            int ret = ::sendmmsg(h_sock_,msgs,(unsigned)n,MSG_NOSIGNAL);
+            if(ret == SOCKET_ERROR){
+                if(count && would_block(fast_err())) break;
+                return Result<int>(false,std::move(count),TMC_R_CALL_POS(fast_err()));
+            }
+            count += ret;
+            if((size_t)ret<n) break;
+        }
+#elif defined(_WIN32)
+        for(;(size_t)count<_dgs.size();count++){
+            Datagram const& dg = _dgs[count];
+            int ret = ::sendto(h_sock_,(const char*)dg.data.data(),(int)dg.size,0,(sockaddr const*)&dg.addr.addr_in_,(int)sizeof(sockaddr_in));
+            if(ret == SOCKET_ERROR){
+                if(count && would_block(fast_err())) break;
+                return Result<int>(false,std::move(count),TMC_R_CALL_POS(fast_err()));
+            }
+        }
+#endif
+        return Result<int>(true,std::move(count));
+    }
+
+    // send buf as datagrams of _seg_size bytes, the last one may be shorter
+    // with UDP_SEGMENT the kernel splits one big send, so the cost is per send
+    // not per datagram; without it there is one sendto per datagram
+    // if the kernel or the route refuses UDP_SEGMENT, this socket falls back to sendto
+    // return count of datagrams sent
+    Result<int> write_segmented_to(ByteBuf const& buf,IPAddr const& tar,uint16_t _seg_size){
+        if(!_seg_size){
+            return Result<int>(false,0,TMC_R_CALL_POS(EINVAL));
+        }
+        const char* content = (const char*)buf.view();
+        size_t offset = 0;
+        size_t left_size = buf.size();
+        int count = 0;
+#if defined(__linux__) && defined(UDP_SEGMENT)
+        size_t max_segments = 65000/_seg_size;
+        max_segments = max_segments>TMC_GSO_MAX_SEGMENTS?TMC_GSO_MAX_SEGMENTS:max_segments;
+        if(!max_segments){
+            return Result<int>(false,0,TMC_R_CALL_POS(EMSGSIZE));
+        }
+        size_t per_send = max_segments*_seg_size;
+        while(left_size && !gso_refused_){
+            size_t chunk = left_size<per_send?left_size:per_send;
+            iovec iov;
+            iov.iov_base = (void*)(content+offset);
+            iov.iov_len = chunk;
+            char control[CMSG_SPACE(sizeof(uint16_t))];
+            ::memset(control,0,sizeof(control));
+            msghdr msg;
+            ::memset(&msg,0,sizeof(msg));
+            msg.msg_name = (void*)&tar.addr_in_;
+            msg.msg_namelen = sizeof(sockaddr_in);
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            if(chunk>_seg_size){
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+                cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                ::memcpy(CMSG_DATA(cm),&_seg_size,sizeof(uint16_t));
+            }
+            int ret = (int)::sendmsg(h_sock_,&msg,MSG_NOSIGNAL);
+            if(ret == SOCKET_ERROR){
+                int ec = fast_err();
+                if(msg.msg_control && (ec == EINVAL || ec == ENOPROTOOPT || ec == EIO)){
+                    // e.g. an old kernel or no checksum offload on the route,
+                    // a real error shows up again on the sendto below
+                    gso_refused_ = true;
+                    break;
+                }
+                return Result<int>(false,std::move(count),TMC_R_CALL_POS(ec));
+            }
+            offset += chunk;
+            left_size -= chunk;
+            count += (int)((chunk+_seg_size-1)/_seg_size);
+        }
+#endif
+        while(left_size){
+            size_t chunk = left_size<_seg_size?left_size:_seg_size;
+            int ret = ::sendto(h_sock_,content+offset,(int)chunk,MSG_NOSIGNAL,(sockaddr const*)&tar.addr_in_,(int)sizeof(sockaddr_in));
+            if(ret == SOCKET_ERROR){
+                return Result<int>(false,std::move(count),TMC_R_CALL_POS(fast_err()));
+            }
+            offset += chunk;
+            left_size -= chunk;
+            count++;
+        }
+        return Result<int>(true,std::move(count));
+    }
+
+    // receive once into _storage and split a GRO coalesced receive
+    // back into its datagrams, no copies: each _out entry points into _storage
+    // without set_udp_gro(true) this is always one datagram
+    // return count of datagrams, extra ones are dropped if _out is too short
+    Result<int> read_segmented_from(std::span<Byte> _storage,std::span<Datagram> _out){
+        if(_out.empty()){
+            return Result<int>(false,0,TMC_R_CALL_POS(EINVAL));
+        }
+        sockaddr_in from;
+        ::memset(&from,0,sizeof(from));
+#if defined(__linux__) && defined(UDP_GRO)
+        iovec iov;
+        iov.iov_base = _storage.data();
+        iov.iov_len = _storage.size();
+        char control[CMSG_SPACE(sizeof(int))];
+        msghdr msg;
+        ::memset(&msg,0,sizeof(msg));
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        int ret = (int)::recvmsg(h_sock_,&msg,0);
+        if(ret == SOCKET_ERROR){
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
+        }
+        int seg_size = ret;
+        for(cmsghdr* cm = CMSG_FIRSTHDR(&msg);cm;cm = CMSG_NXTHDR(&msg,cm)){
+            if(cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO){
+                ::memcpy(&seg_size,CMSG_DATA(cm),sizeof(int));
+            }
+        }
+        bool truncated = (msg.msg_flags & MSG_TRUNC) != 0;
+#else
+        int from_len = sizeof(from);
+        int ret = ::recvfrom(h_sock_,(char*)_storage.data(),(int)_storage.size(),0,(sockaddr*)&from,&from_len);
+        if(ret == SOCKET_ERROR){
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
+        }
+        int seg_size = ret;
+        bool truncated = false;
+#endif
+        if(seg_size<=0){
+            seg_size = ret>0?ret:1;
+        }
+        int count = 0;
+        for(size_t off = 0;(off<(size_t)ret || (!ret && !count)) && (size_t)count<_out.size();off += seg_size){
+            size_t len = (size_t)ret-off<(size_t)seg_size?(size_t)ret-off:(size_t)seg_size;
+            _out[count].data = _storage.subspan(off,len);
+            _out[count].size = len;
+            _out[count].addr = IPAddr::v4(from);
+            _out[count].truncated = truncated;
+            count++;
+        }
+        return Result<int>(true,std::move(count));
+    }
+
     // socket select function
     // return 0 error
     // return 1 recv
     // return 2 send
     Result<bool,bool,bool> select(std::chrono::milliseconds const& _timeout){
         std::tuple<bool,bool,bool> res = {false,false,false};
-        auto _ms = _timeout.count();
-        timeval _tval;
-        _tval.tv_sec = (decltype(timeval::tv_sec))_ms/1000;
-        _tval.tv_usec = (decltype(timeval::tv_usec))_ms%1000;
-        fd_set _recv_set;
-        fd_set _send_set;
-        fd_set _err_set;
-        FD_ZERO(&_recv_set);
-        FD_ZERO(&_send_set);
-        FD_ZERO(&_err_set);
-        FD_SET(h_sock_,&_recv_set);
-        FD_SET(h_sock_,&_send_set);
-        FD_SET(h_sock_,&_err_set);
-        int _ret = ::select((int)h_sock_+1,&_recv_set,&_send_set,&_err_set,&_tval);
-        if(_ret == SOCKET_ERROR){
-            return Result<bool,bool,bool>(false,std::move(res),TMC_R_CALL_POS(exact_err().ignore()));
-        }
-        else{
-            if(FD_ISSET(h_sock_,&_recv_set)){// read
-                std::get<1>(res) = true;
-            }
-            if(FD_ISSET(h_sock_,&_send_set)){
-                std::get<2>(res) = true;
-            }
-            if(FD_ISSET(h_sock_,&_err_set)){
-                std::get<0>(res) = true;
-            }
-            return Result<bool,bool,bool>(true,std::move(res),TMC_R_CALL_POS(exact_err().ignore()));
-        }
-    }
-
-    // use select to check if the read buf is currently avaliable
+        auto poll_res = __poll(POLLIN|POLLOUT,(int)_timeout.count());
+        if(!poll_res.check()){
+            return Result<bool,bool,bool>(false,std::move(res),TMC_R_CALL_POS(fast_err()));
+        }
+        short revents = poll_res.ignore();
+        std::get<0>(res) = (revents&(POLLERR|POLLNVAL))!=0;
+        std::get<1>(res) = (revents&(POLLIN|POLLHUP))!=0;
+        std::get<2>(res) = (revents&POLLOUT)!=0;
+        return Result<bool,bool,bool>(true,std::move(res));
+    }
+
+    // use poll to check if the read buf is currently avaliable
     // Result can be ignored, will return false on error
     Result<bool> readable(){
-        timeval _tval;
-        _tval.tv_sec = 0;
-        _tval.tv_usec = 0;
-        fd_set set;
-        fd_set _err_set;
-        FD_ZERO(&set);
-        FD_ZERO(&_err_set);
-        FD_SET(h_sock_,&set);
-        FD_SET(h_sock_,&_err_set);
-        if(::select((int)h_sock_+1,&set,0,&_err_set,&_tval) == SOCKET_ERROR){
-            return Result<bool>(false,false);
-        }
-        if(FD_ISSET(h_sock_,&_err_set)){
-            if(FD_ISSET(h_sock_,&set)){// read
-                return Result<bool>(false,true,TMC_R_CALL_POS(exact_err().ignore()));
-            }else{
-                return Result<bool>(false,false,TMC_R_CALL_POS(exact_err().ignore()));
-            }
-        }else{
-            if(FD_ISSET(h_sock_,&set)){// read
-                return Result<bool>(true,true);
-            }else{
-                return Result<bool>(true,false);
-            }
+        auto poll_res = __poll(POLLIN,0);
+        if(!poll_res.check()){
+            return Result<bool>(false,false,TMC_R_CALL_POS(fast_err()));
+        }
+        short revents = poll_res.ignore();
+        bool can_read = (revents&(POLLIN|POLLHUP))!=0;
+        if(revents&(POLLERR|POLLNVAL)){
+            return Result<bool>(false,std::move(can_read),TMC_R_CALL_POS(exact_err().ignore()));
         }
+        return Result<bool>(true,std::move(can_read));
     }
 
-    // use select to check if the write buf is currently avaliable
+    // use poll to check if the write buf is currently avaliable
     // Result can be ignored, will return false on error
     Result<bool> writeable(){
-        timeval _tval;
-        _tval.tv_sec = 0;
-        _tval.tv_usec = 0;
-        fd_set set;
-        fd_set _err_set;
-        FD_ZERO(&set);
-        FD_ZERO(&_err_set);
-        FD_SET(h_sock_,&set);
-        FD_SET(h_sock_,&_err_set);
-        if(::select((int)h_sock_+1,0,&set,&_err_set,&_tval) == SOCKET_ERROR){
-            return Result<bool>(false,false);
-        }
-        if(FD_ISSET(h_sock_,&_err_set)){
-            if(FD_ISSET(h_sock_,&set)){// read
-                return Result<bool>(false,true,TMC_R_CALL_POS(exact_err().ignore()));
-            }else{
-                return Result<bool>(false,false,TMC_R_CALL_POS(exact_err().ignore()));
-            }
-        }else{
-            if(FD_ISSET(h_sock_,&set)){// read
-                return Result<bool>(true,true);
-            }else{
-                return Result<bool>(true,false);
-            }
+        auto poll_res = __poll(POLLOUT,0);
+        if(!poll_res.check()){
+            return Result<bool>(false,false,TMC_R_CALL_POS(fast_err()));
         }
+        short revents = poll_res.ignore();
+        bool can_write = (revents&POLLOUT)!=0;
+        if(revents&(POLLERR|POLLNVAL)){
+            return Result<bool>(false,std::move(can_write),TMC_R_CALL_POS(exact_err().ignore()));
+        }
+        return Result<bool>(true,std::move(can_write));
     }
 
     // wait until sock is readable
@@ -648,38 +2265,14 @@ public:
     // return err(false) 
     // if timeout is 0 wait forever
     // if you do not want to wait, please use readable
+    // to wait on many sockets at once, use Reactor::await_readable
     Result<bool> await_readable(std::chrono::milliseconds const& timeout){
-        if(timeout == std::chrono::milliseconds(0)){
-            // wait forever
-            try_readable:{
-                Result<bool> readable_res = readable();
-                if(readable_res.check()){
-                    if(readable_res.ignore()){
-                        return Result<bool>::ok(true);
-                    }else{
-                        goto try_readable;
-                    }
-                }else{
-                    return Result<bool>::err(false,TMC_R_CALL_POS(exact_err().ignore()));
-                }
-            }
-        }else{
-            size_t count = timeout.count();
-            timeval _tval;
-            _tval.tv_sec = (int)count/1000;
-            _tval.tv_usec = (int)count%1000;
-            fd_set set;
-            FD_ZERO(&set);
-            FD_SET(h_sock_,&set);
-            if(::select((int)h_sock_+1,&set,0,0,&_tval) == SOCKET_ERROR){
-                return Result<bool>::err(false,TMC_R_CALL_POS(exact_err().ignore()));
-            }
-            if(FD_ISSET(h_sock_,&set)){// read
-                return Result<bool>::ok(true);
-            }else{
-                return Result<bool>::ok(false);
-            }
+        int _ms = timeout == std::chrono::milliseconds(0)? -1 : (int)timeout.count();
+        auto poll_res = __poll(POLLIN,_ms);
+        if(!poll_res.check()){
+            return Result<bool>::err(false,TMC_R_CALL_POS(fast_err()));
         }
+        return Result<bool>::ok((poll_res.ignore()&(POLLIN|POLLHUP|POLLERR))!=0);
     }
 
     // wait until sock is writeable
@@ -688,57 +2281,24 @@ public:
     // return err(false) 
     // if timeout is 0 wait forever
     // if you do not want to wait, please use writeable
+    // to wait on many sockets at once, use Reactor::await_writeable
     Result<bool> await_writeable(std::chrono::milliseconds const& timeout){
-        if(timeout == std::chrono::milliseconds(0)){
-            // wait forever
-            try_writeable:{
-                Result<bool> writeable_res = writeable();
-                if(writeable_res.check()){
-                    if(writeable_res.ignore()){
-                        return Result<bool>::ok(true);
-                    }else{
-                        goto try_writeable;
-                    }
-                }else{
-                    return Result<bool>::err(false,TMC_R_CALL_POS(exact_err().ignore()));
-                }
-            }
-        }else{
-            size_t count = timeout.count();
-            timeval _tval;
-            _tval.tv_sec = (int)count/1000;
-            _tval.tv_usec = (int)count%1000;
-            fd_set set;
-            FD_ZERO(&set);
-            FD_SET(h_sock_,&set);
-            if(::select((int)h_sock_+1,0,&set,0,&_tval) == SOCKET_ERROR){
-                return Result<bool>::err(false,TMC_R_CALL_POS(exact_err().ignore()));
-            }
-            if(FD_ISSET(h_sock_,&set)){// read
-                return Result<bool>::ok(true);
-            }else{
-                return Result<bool>::ok(false);
-            }
+        int _ms = timeout == std::chrono::milliseconds(0)? -1 : (int)timeout.count();
+        auto poll_res = __poll(POLLOUT,_ms);
+        if(!poll_res.check()){
+            return Result<bool>::err(false,TMC_R_CALL_POS(fast_err()));
         }
+        return Result<bool>::ok((poll_res.ignore()&(POLLOUT|POLLERR))!=0);
     }
 
-    // use select to check if has error
+    // use poll to check if has error
     // Result can be ignored, will return false on error
     Result<bool> has_error(){
-        timeval _tval;
-        _tval.tv_sec = 0;
-        _tval.tv_usec = 0;
-        fd_set set;
-        FD_ZERO(&set);
-        FD_SET(h_sock_,&set);
-        if(::select((int)h_sock_+1,0,0,&set,&_tval) == SOCKET_ERROR){
-           return Result<bool>::err(false,TMC_R_CALL_POS(exact_err().ignore()));
-        }
-        if(FD_ISSET(h_sock_,&set)){// error
-            return Result<bool>::ok(true);
-        }else{  // no error
-            return Result<bool>::ok(false);
+        auto poll_res = __poll(0,0);
+        if(!poll_res.check()){
+           return Result<bool>::err(false,TMC_R_CALL_POS(fast_err()));
         }
+        return Result<bool>::ok((poll_res.ignore()&(POLLERR|POLLNVAL))!=0);
     }
     
     // check if there is pending connections
@@ -748,28 +2308,28 @@ public:
     }
 
     // get set
-    template<int _opt>
-    Result<void> setopt(typename GetSockOptDetails<_opt>::type const& val){
+    template<int _opt,int _level = -1>
+    Result<void> setopt(typename GetSockOptDetails<_opt,_level>::type const& val){
         int ret = ::setsockopt(
             h_sock_,
-            GetSockOptDetails<_opt>::level,
+            GetSockOptDetails<_opt,_level>::level,
             _opt,
             (const char*)&val,
-            sizeof(typename GetSockOptDetails<_opt>::type));
-        return Result<void>(ret!=SOCKET_ERROR,TMC_R_CALL_POS(exact_err().ignore()));
+            sizeof(typename GetSockOptDetails<_opt,_level>::type));
+        return Result<void>(ret!=SOCKET_ERROR,TMC_R_CALL_POS(ret!=SOCKET_ERROR?0:__err()));
     }
     
-    template<int _opt>
-    Result<typename GetSockOptDetails<_opt>::type> getopt(){
-        Result<typename GetSockOptDetails<_opt>::type> res(true,TMC_R_CALL_POS(0));
+    template<int _opt,int _level = -1>
+    Result<typename GetSockOptDetails<_opt,_level>::type> getopt(){
+        Result<typename GetSockOptDetails<_opt,_level>::type> res(true,TMC_R_CALL_POS(0));
 #ifdef __linux__
-        socklen_t len = sizeof(typename GetSockOptDetails<_opt>::type);
+        socklen_t len = sizeof(typename GetSockOptDetails<_opt,_level>::type);
 #elif defined(_WIN32)
-        int len = sizeof(typename GetSockOptDetails<_opt>::type);
+        int len = sizeof(typename GetSockOptDetails<_opt,_level>::type);
 #endif
         int ret = ::getsockopt(
             h_sock_,
-            GetSockOptDetails<_opt>::level,
+            GetSockOptDetails<_opt,_level>::level,
             _opt,
             (char*)&res.ignore(),
             &len);
@@ -812,6 +2372,7 @@ public:
 
     // buf size
     Result<void> set_write_bufsize(int bufsize){
+        write_bufsize_ = 0;     // the kernel may round it, read it back on next use
         return setopt<SO_SNDBUF>(bufsize);
     }
 
@@ -820,6 +2381,7 @@ public:
     }
 
     Result<void> set_read_bufsize(int bufsize){
+        read_bufsize_ = 0;
         return setopt<SO_RCVBUF>(bufsize);
     }
 
@@ -897,6 +2459,107 @@ public:
         return Result<bool>(res.check(),(bool)res.ignore());
     }
 
+#ifdef UDP_SEGMENT
+    // udp segmentation offload
+    // every send bigger than _seg_size goes out as datagrams of _seg_size
+    // 0 turns it off
+    Result<void> set_udp_gso_size(int _seg_size){
+        return setopt<UDP_SEGMENT>(_seg_size);
+    }
+    Result<int> get_udp_gso_size(){
+        return getopt<UDP_SEGMENT>();
+    }
+
+    // udp receive offload, back to back datagrams may arrive as one receive
+    // use read_segmented_from to split them
+    Result<void> set_udp_gro(bool _enable){
+        return setopt<UDP_GRO>((int)_enable);
+    }
+#endif
+
+    // set every option of _profile that is not -1
+    // TCP options are skipped on other sockets and IP_TOS on AF_UNIX ones,
+    // so one profile fits tcp and udp alike
+    // stops at the first option the kernel refuses
+    // buffer sizes are read back so write_all / readall never ask again
+    Result<void> apply_profile(SocketProfile const& _profile){
+        Result<void> res(true);
+        auto apply = [&](int _value,auto _set){
+            if(_value>=0 && res.check()){
+                res = _set(_value);
+            }
+        };
+        bool tcp = protocol_ == Protocol::TCP;
+#ifdef SO_PROTOCOL
+        if(protocol_ == Protocol::P_OTHER){
+            auto proto_res = getopt<SO_PROTOCOL>();
+            tcp = proto_res.check() && proto_res.ignore() == IPPROTO_TCP;
+        }
+#endif
+        bool unix_family = protocol_ == Protocol::UNIX_STREAM || protocol_ == Protocol::UNIX_SEQPACKET;
+        if(tcp){
+            apply(_profile.nodelay,[this](int v){return setopt<TCP_NODELAY>(v);});
+#ifdef TCP_QUICKACK
+            apply(_profile.quickack,[this](int v){return setopt<TCP_QUICKACK>(v);});
+#endif
+#ifdef TCP_CORK
+            apply(_profile.cork,[this](int v){return setopt<TCP_CORK,IPPROTO_TCP>(v);});
+#endif
+#ifdef TCP_FASTOPEN
+            apply(_profile.fastopen,[this](int v){return setopt<TCP_FASTOPEN>(v);});
+#endif
+        }
+#ifdef SO_BUSY_POLL
+        apply(_profile.busy_poll,[this](int v){return setopt<SO_BUSY_POLL>(v);});
+#endif
+#ifdef SO_REUSEPORT
+        apply(_profile.reuseport,[this](int v){return setopt<SO_REUSEPORT>(v);});
+#endif
+        apply(_profile.write_bufsize,[this](int v){return set_write_bufsize(v);});
+        apply(_profile.read_bufsize,[this](int v){return set_read_bufsize(v);});
+        if(!unix_family){
+            apply(_profile.tos,[this](int v){return setopt<IP_TOS,IPPROTO_IP>(v);});
+        }
+        if(!res.check()){
+            return res;
+        }
+        if(!__cached_write_bufsize().check() || !__cached_read_bufsize().check()){
+            return {false,TMC_R_CALL_POS(fast_err())};
+        }
+        return res;
+    }
+
+#ifdef TCP_CORK
+    // hold partial frames in the kernel until set_cork(false)
+    Result<void> set_cork(bool _cork){
+        return setopt<TCP_CORK,IPPROTO_TCP>((int)_cork);
+    }
+#endif
+
+    // send with MSG_MORE, the kernel waits for the rest of the frame
+    // the next write without MSG_MORE flushes it
+    // on platforms without MSG_MORE this is a plain write
+    Result<int> write_more(ByteBuf const& buf){
+#ifdef MSG_MORE
+        int ret = ::send(h_sock_,(const char*)buf.view(),(int)buf.size(),MSG_NOSIGNAL|MSG_MORE);
+        if(ret == SOCKET_ERROR){
+            return Result<int>(false,0,TMC_R_CALL_POS(fast_err()));
+        }
+        return Result<int>(true,std::move(ret));
+#else
+        return write(buf);
+#endif
+    }
+
+    // effective SO_SNDBUF, from the cache after the first call
+    Result<int> write_bufsize(){
+        return __cached_write_bufsize();
+    }
+    // effective SO_RCVBUF, from the cache after the first call
+    Result<int> read_bufsize(){
+        return __cached_read_bufsize();
+    }
+
     // get the error number on this socket
     Result<int> exact_err(){
         return getopt<SO_ERROR>();
@@ -912,5 +2575,6 @@ public:
 }
 
 #undef ROUTE_SOCK_OPT
+#undef ROUTE_SOCK_OPT_AT
 
 #endif
\ No newline at end of file
@@ -0,0 +1,658 @@
+/*
+MIT License
+
+Copyright (c) 2024 Cenxuan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+*/
+
+#ifndef __TMC_URING_HPP__
+#define __TMC_URING_HPP__
+
+#include "tmc_Socket.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define TMC_HAS_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <signal.h>
+#endif
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <chrono>
+
+namespace TMC{
+
+#ifdef TMC_HAS_URING
+
+// io_uring based completion engine
+// ops are queued as SQEs and submitted in one batch by submit / poll_once
+// completions are reaped in poll_once and dispatched to the callbacks
+// no liburing needed, the rings are mapped by hand
+// callbacks may refer to the ring, do not move it while ops are pending
+class Uring{
+public:
+    typedef std::function<void(Result<int>&)> WriteCallback;
+    typedef std::function<void(Result<ByteBuf>&)> ReadCallback;
+    typedef std::function<void(Result<Socket>&)> AcceptCallback;
+private:
+    struct _Op{
+        std::function<void(int,uint32_t)> on_cqe;
+        ByteBuf buf;    // kept alive until the send completes, or the storage of a plain recv
+    };
+
+    bool valid_ = false;
+    int h_ring_ = -1;
+    io_uring_params params_;
+
+    void* sq_ptr_ = nullptr;
+    size_t sq_size_ = 0;
+    void* cq_ptr_ = nullptr;
+    size_t cq_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    unsigned sqe_tail_ = 0;     // local tail, published on submit
+    uint64_t next_id_ = 1;
+    std::unordered_map<uint64_t,std::unique_ptr<_Op>> ops_;
+
+    // provided buffers for multishot recv
+    uint16_t buf_group_ = 0;
+    unsigned provided_count_ = 0;
+    unsigned provided_size_ = 0;
+    std::unique_ptr<char[]> provided_;
+    std::vector<unsigned> unprovided_;     // returned while no SQE was free, retried by poll_once
+
+    // registered buffers for fixed read / write
+    unsigned fixed_size_ = 0;
+    std::unique_ptr<char[]> fixed_;
+    std::vector<iovec> fixed_iov_;
+    std::vector<unsigned> fixed_free_;
+    bool send_fixed_buf_ = true;    // false once the kernel refused IORING_RECVSEND_FIXED_BUF
+
+    static int __setup(unsigned _entries,io_uring_params* _p) noexcept{
+        return (int)::syscall(__NR_io_uring_setup,_entries,_p);
+    }
+    static int __enter(int _fd,unsigned _to_submit,unsigned _min_complete,unsigned _flags,void* _arg,size_t _argsz) noexcept{
+        return (int)::syscall(__NR_io_uring_enter,_fd,_to_submit,_min_complete,_flags,_arg,_argsz);
+    }
+    static int __register(int _fd,unsigned _opcode,void* _arg,unsigned _nr_args) noexcept{
+        return (int)::syscall(__NR_io_uring_register,_fd,_opcode,_arg,_nr_args);
+    }
+
+    Uring()noexcept {}//hide
+    Uring(unsigned _entries){//hide
+        ::memset(&params_,0,sizeof(params_));
+        h_ring_ = __setup(_entries,&params_);
+        if(h_ring_ == -1){
+            return;
+        }
+        sq_size_ = params_.sq_off.array + params_.sq_entries*sizeof(unsigned);
+        cq_size_ = params_.cq_off.cqes + params_.cq_entries*sizeof(io_uring_cqe);
+        bool single_mmap = params_.features & IORING_FEAT_SINGLE_MMAP;
+        if(single_mmap){
+            sq_size_ = cq_size_ = sq_size_>cq_size_?sq_size_:cq_size_;
+        }
+        sq_ptr_ = ::mmap(0,sq_size_,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,h_ring_,IORING_OFF_SQ_RING);
+        if(sq_ptr_ == MAP_FAILED){
+            sq_ptr_ = nullptr;
+            return;
+        }
+        if(single_mmap){
+            cq_ptr_ = sq_ptr_;
+        }else{
+            cq_ptr_ = ::mmap(0,cq_size_,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,h_ring_,IORING_OFF_CQ_RING);
+            if(cq_ptr_ == MAP_FAILED){
+                cq_ptr_ = nullptr;
+                return;
+            }
+        }
+        void* sqes = ::mmap(0,params_.sq_entries*sizeof(io_uring_sqe),PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,h_ring_,IORING_OFF_SQES);
+        if(sqes == MAP_FAILED){
+            return;
+        }
+        sqes_ = (io_uring_sqe*)sqes;
+
+        char* sq = (char*)sq_ptr_;
+        sq_head_ = (unsigned*)(sq+params_.sq_off.head);
+        sq_tail_ = (unsigned*)(sq+params_.sq_off.tail);
+        sq_mask_ = (unsigned*)(sq+params_.sq_off.ring_mask);
+        sq_array_ = (unsigned*)(sq+params_.sq_off.array);
+        char* cq = (char*)cq_ptr_;
+        cq_head_ = (unsigned*)(cq+params_.cq_off.head);
+        cq_tail_ = (unsigned*)(cq+params_.cq_off.tail);
+        cq_mask_ = (unsigned*)(cq+params_.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe*)(cq+params_.cq_off.cqes);
+        sqe_tail_ = *sq_tail_;
+        valid_ = true;
+    }
+
+    void __close() noexcept{
+        if(sqes_){
+            ::munmap(sqes_,params_.sq_entries*sizeof(io_uring_sqe));
+            sqes_ = nullptr;
+        }
+        if(cq_ptr_ && cq_ptr_ != sq_ptr_){
+            ::munmap(cq_ptr_,cq_size_);
+        }
+        cq_ptr_ = nullptr;
+        if(sq_ptr_){
+            ::munmap(sq_ptr_,sq_size_);
+            sq_ptr_ = nullptr;
+        }
+        if(h_ring_ != -1){
+            ::close(h_ring_);
+            h_ring_ = -1;
+        }
+        valid_ = false;
+    }
+
+    // get a zeroed SQE, submit the queued ones first if the ring is full
+    io_uring_sqe* __get_sqe(){
+        unsigned head = __atomic_load_n(sq_head_,__ATOMIC_ACQUIRE);
+        if(sqe_tail_-head >= params_.sq_entries){
+            if(!submit().check()){
+                return nullptr;
+            }
+            head = __atomic_load_n(sq_head_,__ATOMIC_ACQUIRE);
+            if(sqe_tail_-head >= params_.sq_entries){
+                return nullptr;
+            }
+        }
+        unsigned index = sqe_tail_ & *sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        ::memset(sqe,0,sizeof(io_uring_sqe));
+        sq_array_[index] = index;
+        sqe_tail_++;
+        return sqe;
+    }
+
+    // publish the local tail, return count of SQEs the kernel has not consumed yet
+    // an SQE that fails to submit stops the batch, the ones after it are counted again
+    unsigned __flush_sq() noexcept{
+        __atomic_store_n(sq_tail_,sqe_tail_,__ATOMIC_RELEASE);
+        return sqe_tail_ - __atomic_load_n(sq_head_,__ATOMIC_ACQUIRE);
+    }
+
+    // bind an op to a new SQE
+    // return the op id, 0 on error
+    uint64_t __queue(io_uring_sqe* _sqe,std::unique_ptr<_Op>&& _op){
+        uint64_t id = next_id_++;
+        _sqe->user_data = id;
+        ops_[id] = std::move(_op);
+        return id;
+    }
+
+    // hand _count provided buffers from _bid on back to the kernel
+    // false if no SQE was free
+    bool __provide(unsigned _bid,unsigned _count){
+        io_uring_sqe* sqe = __get_sqe();
+        if(!sqe){
+            return false;
+        }
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = (int)_count;
+        sqe->addr = (uint64_t)(provided_.get()+(size_t)_bid*provided_size_);
+        sqe->len = provided_size_;
+        sqe->off = _bid;
+        sqe->buf_group = buf_group_;
+        sqe->user_data = 0;    // completion ignored
+        return true;
+    }
+
+    // provide the buffers that could not be handed back when they were consumed
+    void __provide_pending(){
+        while(!unprovided_.empty() && __provide(unprovided_.back(),1)){
+            unprovided_.pop_back();
+        }
+    }
+
+    // queue a send of _buf after its first _offset bytes
+    // the op resubmits itself until everything is sent, the ring must stay in place
+    Result<uint64_t> __send(int _fd,ByteBuf&& _buf,size_t _offset,WriteCallback const& _cb){
+        io_uring_sqe* sqe = __get_sqe();
+        if(!sqe){
+            return Result<uint64_t>(false,0,TMC_R_CALL_POS(EBUSY));
+        }
+        std::unique_ptr<_Op> op(new _Op);
+        _Op* self = op.get();
+        op->buf = std::move(_buf);
+        op->on_cqe = [this,self,_fd,_offset,_cb](int res,uint32_t){
+            size_t sent = _offset+(res>0?res:0);
+            if(res>0 && sent<self->buf.size()){
+                // the op is freed after this returns, its buffer moves on to the next send
+                auto rest = __send(_fd,std::move(self->buf),sent,_cb);
+                if(rest.check()){
+                    return;
+                }
+                Result<int> r(false,(int)sent,TMC_R_CALL_POS(rest.error_code()));
+                _cb(r);
+                return;
+            }
+            Result<int> r(res>=0,(int)sent,TMC_R_CALL_POS(res>=0?0:-res));
+            _cb(r);
+        };
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = _fd;
+        sqe->addr = (uint64_t)(op->buf.view()+_offset);
+        sqe->len = (uint32_t)(op->buf.size()-_offset);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        return Result<uint64_t>::ok(__queue(sqe,std::move(op)));
+    }
+
+    // queue a send of the first _len bytes of registered buffer _index
+    // the buffer is released when the callback runs
+    Result<uint64_t> __send_fixed(int _fd,unsigned _index,uint32_t _len,WriteCallback const& _cb){
+        io_uring_sqe* sqe = __get_sqe();
+        if(!sqe){
+            return Result<uint64_t>(false,0,TMC_R_CALL_POS(EBUSY));
+        }
+        bool fixed = send_fixed_buf_;
+        std::unique_ptr<_Op> op(new _Op);
+        op->on_cqe = [this,_cb,_fd,_index,_len,fixed](int res,uint32_t){
+            if(res == -EINVAL && fixed){
+                send_fixed_buf_ = false;
+                if(__send_fixed(_fd,_index,_len,_cb).check()){
+                    return;
+                }
+            }
+            Result<int> r(res>=0,res>=0?res:0,TMC_R_CALL_POS(res>=0?0:-res));
+            fixed_free_.push_back(_index);
+            _cb(r);
+        };
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = _fd;
+        sqe->addr = (uint64_t)fixed_iov_[_index].iov_base;
+        sqe->len = _len;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        if(fixed){
+            sqe->ioprio |= IORING_RECVSEND_FIXED_BUF;
+            sqe->buf_index = (uint16_t)_index;
+        }
+        return Result<uint64_t>::ok(__queue(sqe,std::move(op)));
+    }
+
+    void __reap(){
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_,__ATOMIC_ACQUIRE);
+        while(head != tail){
+            io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+            uint64_t id = cqe->user_data;
+            int res = cqe->res;
+            uint32_t flags = cqe->flags;
+            head++;
+            __atomic_store_n(cq_head_,head,__ATOMIC_RELEASE);
+            if(id){
+                auto it = ops_.find(id);
+                if(it != ops_.end()){
+                    // the op is only freed after its last CQE
+                    // keep it alive while the callback runs
+                    std::unique_ptr<_Op> op;
+                    if(!(flags & IORING_CQE_F_MORE)){
+                        op = std::move(it->second);
+                        ops_.erase(it);
+                        op->on_cqe(res,flags);
+                    }else{
+                        it->second->on_cqe(res,flags);
+                    }
+                }
+            }
+            tail = __atomic_load_n(cq_tail_,__ATOMIC_ACQUIRE);
+        }
+    }
+
+public:
+    Uring(Uring const&) = delete;
+    Uring& operator=(Uring const&) = delete;
+    Uring(Uring && other) noexcept{
+        *this = std::move(other);
+    }
+    Uring& operator=(Uring && other) noexcept{
+        if(this != &other){
+            __close();
+            valid_ = other.valid_;
+            h_ring_ = other.h_ring_;
+            params_ = other.params_;
+            sq_ptr_ = other.sq_ptr_;
+            sq_size_ = other.sq_size_;
+            cq_ptr_ = other.cq_ptr_;
+            cq_size_ = other.cq_size_;
+            sqes_ = other.sqes_;
+            sq_head_ = other.sq_head_;
+            sq_tail_ = other.sq_tail_;
+            sq_mask_ = other.sq_mask_;
+            sq_array_ = other.sq_array_;
+            cq_head_ = other.cq_head_;
+            cq_tail_ = other.cq_tail_;
+            cq_mask_ = other.cq_mask_;
+            cqes_ = other.cqes_;
+            sqe_tail_ = other.sqe_tail_;
+            next_id_ = other.next_id_;
+            ops_ = std::move(other.ops_);
+            buf_group_ = other.buf_group_;
+            provided_count_ = other.provided_count_;
+            provided_size_ = other.provided_size_;
+            provided_ = std::move(other.provided_);
+            unprovided_ = std::move(other.unprovided_);
+            fixed_size_ = other.fixed_size_;
+            fixed_ = std::move(other.fixed_);
+            fixed_iov_ = std::move(other.fixed_iov_);
+            fixed_free_ = std::move(other.fixed_free_);
+            send_fixed_buf_ = other.send_fixed_buf_;
+            other.valid_ = false;
+            other.h_ring_ = -1;
+            other.sq_ptr_ = other.cq_ptr_ = nullptr;
+            other.sqes_ = nullptr;
+        }
+        return *this;
+    }
+    ~Uring(){
+        __close();
+    }
+
+    // check if io_uring can be used on this kernel
+    // (it may be missing or blocked by seccomp)
+    static bool supported() noexcept{
+        io_uring_params p;
+        ::memset(&p,0,sizeof(p));
+        int fd = __setup(2,&p);
+        if(fd == -1){
+            return false;
+        }
+        ::close(fd);
+        return (p.features & IORING_FEAT_EXT_ARG) != 0;
+    }
+
+    // create a ring
+    // param _entries size of the submission queue
+    static Result<Uring> create(unsigned _entries = 256){
+        Uring res(_entries);
+        if(res.valid_ && !(res.params_.features & IORING_FEAT_EXT_ARG)){
+            res.__close();  // need timed waits
+            return Result<Uring>(false,std::move(res),TMC_R_CALL_POS(ENOSYS));
+        }
+        return Result<Uring>(res.valid_,std::move(res),TMC_R_CALL_POS(res.valid_?0:sys_errno()));
+    }
+
+    bool valid()const noexcept{
+        return valid_;
+    }
+
+    int native_handle()const noexcept{
+        return h_ring_;
+    }
+
+    // count of ops waiting for completion
+    size_t pending()const noexcept{
+        return ops_.size();
+    }
+
+    // send the whole ByteBuf, the buffer is kept until completion
+    // a short send is resubmitted from where it stopped, the callback runs once at the end
+    // return the op id of the first send
+    Result<uint64_t> send(Socket const& _sock,ByteBuf&& _buf,WriteCallback const& _cb){
+        return __send(_sock.native_handle(),std::move(_buf),0,_cb);
+    }
+
+    // recv at most _size bytes
+    // return the op id
+    Result<uint64_t> recv(Socket const& _sock,int _size,ReadCallback const& _cb){
+        io_uring_sqe* sqe = __get_sqe();
+        if(!sqe){
+            return Result<uint64_t>(false,0,TMC_R_CALL_POS(EBUSY));
+        }
+        std::unique_ptr<_Op> op(new _Op);
+        _Op* self = op.get();
+        op->buf.reserve(_size);     // the kernel writes straight into the op's ByteBuf
+        op->on_cqe = [_cb,self](int res,uint32_t){
+            if(res>0){
+                self->buf.commit(res);
+            }
+            Result<ByteBuf> r(res>=0,std::move(self->buf),TMC_R_CALL_POS(res>=0?0:-res));
+            _cb(r);
+        };
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = _sock.native_handle();
+        sqe->addr = (uint64_t)op->buf.spare();
+        sqe->len = (uint32_t)_size;
+        return Result<uint64_t>::ok(__queue(sqe,std::move(op)));
+    }
+
+    // accept connections
+    // param _multishot keep accepting until cancelled, one callback per connection
+    // return the op id
+    Result<uint64_t> accept(Socket const& _sock,AcceptCallback const& _cb,bool _multishot = false){
+        io_uring_sqe* sqe = __get_sqe();
+        if(!sqe){
+            return Result<uint64_t>(false,0,TMC_R_CALL_POS(EBUSY));
+        }
+        std::unique_ptr<_Op> op(new _Op);
+        Socket::Protocol protocol = _sock.protocol();
+        op->on_cqe = [_cb,protocol](int res,uint32_t){
+            if(res<0){
+                Result<Socket> r = Socket::from_native(INVALID_SOCKET,protocol);
+                r.set_ec(-res);
+                _cb(r);
+                return;
+            }
+            Result<Socket> r = Socket::from_native(res,protocol);
+            _cb(r);
+        };
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = _sock.native_handle();
+        sqe->accept_flags = SOCK_CLOEXEC;
+        if(_multishot){
+            sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+        }
+        return Result<uint64_t>::ok(__queue(sqe,std::move(op)));
+    }
+
+    // hand _count buffers of _size bytes to the kernel for multishot recv
+    // call once before recv_multishot
+    Result<void> provide_buffers(unsigned _count,unsigned _size,uint16_t _group = 1){
+        provided_.reset(new char[(size_t)_count*_size]);
+        provided_count_ = _count;
+        provided_size_ = _size;
+        buf_group_ = _group;
+        unprovided_.clear();
+        if(!__provide(0,_count)){
+            return {false,TMC_R_CALL_POS(EBUSY)};
+        }
+        return submit().check();
+    }
+
+    // recv until cancelled or error, one callback per received chunk
+    // the kernel picks the storage from provide_buffers
+    // return the op id
+    Result<uint64_t> recv_multishot(Socket const& _sock,ReadCallback const& _cb){
+        if(!provided_count_){
+            return Result<uint64_t>(false,0,TMC_R_CALL_POS(ENOBUFS));
+        }
+        io_uring_sqe* sqe = __get_sqe();
+        if(!sqe){
+            return Result<uint64_t>(false,0,TMC_R_CALL_POS(EBUSY));
+        }
+        std::unique_ptr<_Op> op(new _Op);
+        op->on_cqe = [this,_cb](int res,uint32_t flags){
+            Result<ByteBuf> r(res>=0,ByteBuf(),TMC_R_CALL_POS(res>=0?0:-res));
+            if(flags & IORING_CQE_F_BUFFER){
+                unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                if(res>0){
+                    r.ignore().ArrBuf<Byte>::push_back((Byte const*)(provided_.get()+(size_t)bid*provided_size_),res);
+                }
+                if(!__provide(bid,1)){
+                    unprovided_.push_back(bid);
+                }
+            }
+            _cb(r);
+        };
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = _sock.native_handle();
+        sqe->ioprio |= IORING_RECV_MULTISHOT;
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = buf_group_;
+        return Result<uint64_t>::ok(__queue(sqe,std::move(op)));
+    }
+
+    // register _count buffers of _size bytes with the kernel
+    // so fixed read / write skip the per-op page pinning
+    Result<void> register_buffers(unsigned _count,unsigned _size){
+        fixed_.reset(new char[(size_t)_count*_size]);
+        fixed_size_ = _size;
+        fixed_iov_.resize(_count);
+        fixed_free_.clear();
+        for(unsigned i = 0;i<_count;i++){
+            fixed_iov_[i].iov_base = fixed_.get()+(size_t)i*_size;
+            fixed_iov_[i].iov_len = _size;
+            fixed_free_.push_back(_count-1-i);
+        }
+        int ret = __register(h_ring_,IORING_REGISTER_BUFFERS,fixed_iov_.data(),_count);
+        if(ret<0){
+            return {false,TMC_R_CALL_POS(sys_errno())};
+        }
+        return true;
+    }
+
+    // recv at most _size bytes into a registered buffer
+    // return the op id
+    Result<uint64_t> recv_fixed(Socket const& _sock,unsigned _size,ReadCallback const& _cb){
+        if(fixed_free_.empty()){
+            return Result<uint64_t>(false,0,TMC_R_CALL_POS(ENOBUFS));
+        }
+        io_uring_sqe* sqe = __get_sqe();
+        if(!sqe){
+            return Result<uint64_t>(false,0,TMC_R_CALL_POS(EBUSY));
+        }
+        unsigned index = fixed_free_.back();
+        fixed_free_.pop_back();
+        std::unique_ptr<_Op> op(new _Op);
+        op->on_cqe = [this,_cb,index](int res,uint32_t){
+            Result<ByteBuf> r(res>=0,ByteBuf(),TMC_R_CALL_POS(res>=0?0:-res));
+            if(res>0){
+                r.ignore().ArrBuf<Byte>::push_back((Byte const*)fixed_iov_[index].iov_base,res);
+            }
+            fixed_free_.push_back(index);
+            _cb(r);
+        };
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->fd = _sock.native_handle();
+        sqe->addr = (uint64_t)fixed_iov_[index].iov_base;
+        sqe->len = _size>fixed_size_?fixed_size_:_size;
+        sqe->buf_index = (uint16_t)index;
+        return Result<uint64_t>::ok(__queue(sqe,std::move(op)));
+    }
+
+    // send from a registered buffer with MSG_NOSIGNAL
+    // _buf must fit into one registered buffer
+    // uses IORING_RECVSEND_FIXED_BUF, a kernel without it for plain sends
+    // gets the same send from the buffer's address instead
+    // return the op id
+    Result<uint64_t> send_fixed(Socket const& _sock,ByteBuf const& _buf,WriteCallback const& _cb){
+        if(fixed_free_.empty() || _buf.size()>fixed_size_){
+            return Result<uint64_t>(false,0,TMC_R_CALL_POS(ENOBUFS));
+        }
+        unsigned index = fixed_free_.back();
+        fixed_free_.pop_back();
+        ::memcpy(fixed_iov_[index].iov_base,_buf.view(),_buf.size());
+        auto res = __send_fixed(_sock.native_handle(),index,(uint32_t)_buf.size(),_cb);
+        if(!res.check()){
+            fixed_free_.push_back(index);
+        }
+        return res;
+    }
+
+    // cancel a pending op, e.g. a multishot accept / recv
+    // its callback is still called with ECANCELED
+    Result<void> cancel(uint64_t _op_id){
+        io_uring_sqe* sqe = __get_sqe();
+        if(!sqe){
+            return {false,TMC_R_CALL_POS(EBUSY)};
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = _op_id;
+        sqe->user_data = 0;
+        return true;
+    }
+
+    // submit all queued ops with one syscall
+    Result<int> submit(){
+        unsigned to_submit = __flush_sq();
+        if(!to_submit){
+            return Result<int>::ok(0);
+        }
+        int ret = __enter(h_ring_,to_submit,0,0,nullptr,0);
+        if(ret<0){
+            return Result<int>(false,0,TMC_R_CALL_POS(sys_errno()));
+        }
+        return Result<int>::ok(std::move(ret));
+    }
+
+    // submit queued ops and wait for completions in the same syscall
+    // then dispatch every completion
+    // param _timeout < 0 wait forever, 0 return immediately
+    Result<void> poll_once(std::chrono::milliseconds const& _timeout){
+        __provide_pending();
+        unsigned to_submit = __flush_sq();
+        bool has_cqe = *cq_head_ != __atomic_load_n(cq_tail_,__ATOMIC_ACQUIRE);
+        unsigned min_complete = (has_cqe || _timeout.count()==0)?0:1;
+
+        __kernel_timespec ts;
+        io_uring_getevents_arg arg;
+        ::memset(&arg,0,sizeof(arg));
+        arg.sigmask_sz = _NSIG/8;
+        if(_timeout.count()>0){
+            ts.tv_sec = _timeout.count()/1000;
+            ts.tv_nsec = (_timeout.count()%1000)*1000000;
+            arg.ts = (uint64_t)&ts;
+        }
+        if(to_submit || min_complete){
+            int ret = __enter(h_ring_,to_submit,min_complete,
+                (min_complete?IORING_ENTER_GETEVENTS:0)|IORING_ENTER_EXT_ARG,&arg,sizeof(arg));
+            if(ret<0 && sys_errno()!=ETIME && sys_errno()!=EINTR){
+                return {false,TMC_R_CALL_POS(sys_errno())};
+            }
+        }
+        __reap();
+        return true;
+    }
+};
+
+#endif
+
+}
+
+
+#endif